@@ -0,0 +1,125 @@
+#pragma once
+#include "bench.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace plusar
+{
+    namespace bench
+    {
+        // Reads the results written by 'plusar-bench --json'. Only the name, elements and samples_ns fields are used.
+        inline std::vector<result> load_results(std::string const &path)
+        {
+            std::ifstream file(path);
+            if (!file)
+                throw std::runtime_error("can't read " + path);
+
+            std::stringstream buffer;
+            buffer << file.rdbuf();
+            std::string const json = buffer.str();
+
+            auto value_of = [&](std::string const &key, size_t from, size_t to) -> size_t
+            {
+                auto pos = json.find("\"" + key + "\"", from);
+                if (pos == std::string::npos || pos >= to)
+                    throw std::runtime_error(path + ": missing \"" + key + "\"");
+                pos = json.find(':', pos);
+                return json.find_first_not_of(" \t\r\n", pos + 1);
+            };
+
+            std::vector<result> results;
+
+            for(size_t begin = json.find('{', json.find('[')); begin != std::string::npos; begin = json.find('{', begin + 1))
+            {
+                size_t const end = json.find('}', begin);
+                if (end == std::string::npos)
+                    break;
+
+                result r{ {}, 0, {} };
+
+                size_t pos = value_of("name", begin, end) + 1;
+                r.name = json.substr(pos, json.find('"', pos) - pos);
+
+                r.elements = std::strtoull(json.c_str() + value_of("elements", begin, end), nullptr, 10);
+
+                pos = value_of("samples_ns", begin, end) + 1;
+                for(;;)
+                {
+                    char *stop = nullptr;
+                    double const v = std::strtod(json.c_str() + pos, &stop);
+                    if (stop == json.c_str() + pos)
+                        break;
+                    r.samples_ns.push_back(v);
+                    pos = json.find_first_not_of(", \t\r\n", stop - json.c_str());
+                }
+
+                if (r.elements == 0 || r.samples_ns.empty())
+                    throw std::runtime_error(path + ": no samples for " + r.name);
+
+                results.push_back(std::move(r));
+                begin = end;
+            }
+
+            return results;
+        }
+
+        enum class verdict { unchanged, improved, regressed, added };
+
+        struct comparison
+        {
+            std::string name;
+            double      baseline_ns;    // median ns/element of the baseline
+            double      current_ns;     // median ns/element of this run
+            double      change;         // relative change of ns/element, positive is slower
+            double      noise;          // relative noise of the two runs
+            verdict     status;
+        };
+
+        // A benchmark regresses when its median slowed down by more than 'threshold' (relative)
+        // and the slowdown is larger than the noise of both runs, estimated as three robust
+        // standard deviations (1.4826 * MAD) of each median.
+        inline comparison compare(result const *baseline, result const &current, double threshold)
+        {
+            comparison c{ current.name, 0, current.ns_per_element(), 0, 0, verdict::added };
+            if (!baseline)
+                return c;
+
+            c.baseline_ns = baseline->ns_per_element();
+
+            double const sigma_base = 1.4826 * baseline->mad_ns() / baseline->elements;
+            double const sigma_current = 1.4826 * current.mad_ns() / current.elements;
+            double const delta = c.current_ns - c.baseline_ns;
+
+            c.change = delta / c.baseline_ns;
+            c.noise = 3 * std::hypot(sigma_base, sigma_current) / c.baseline_ns;
+
+            double const significant = std::max(threshold, c.noise);
+
+            if (c.change > significant)
+                c.status = verdict::regressed;
+            else if (-c.change > significant)
+                c.status = verdict::improved;
+            else
+                c.status = verdict::unchanged;
+
+            return c;
+        }
+
+        inline char const * to_string(verdict v)
+        {
+            switch(v)
+            {
+                case verdict::improved:     return "improved";
+                case verdict::regressed:    return "REGRESSED";
+                case verdict::added:        return "new";
+                default:                    return "ok";
+            }
+        }
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace plusar
+{
+    namespace bench
+    {
+        // Benchmark body: processes 'elements' items and returns a checksum which keeps the work observable
+        using body = std::function<uint64_t(size_t elements)>;
+
+        struct bench_case
+        {
+            std::string name;
+            size_t      elements;
+            body        fn;
+        };
+
+        inline std::vector<bench_case> & cases()
+        {
+            static std::vector<bench_case> registered;
+            return registered;
+        }
+
+        // Measurements of one benchmark
+        struct result
+        {
+            std::string         name;
+            size_t              elements;
+            std::vector<double> samples_ns;     // duration of every measured run
+
+            static double median(std::vector<double> v)
+            {
+                std::sort(v.begin(), v.end());
+                size_t const n = v.size();
+                return n ? (n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2) : 0.0;
+            }
+
+            double median_ns() const
+            {
+                return median(samples_ns);
+            }
+
+            // Median absolute deviation of the samples, a noise estimate robust to outliers
+            double mad_ns() const
+            {
+                double const m = median_ns();
+                std::vector<double> deviations;
+                for(auto s : samples_ns)
+                    deviations.push_back(std::abs(s - m));
+                return median(std::move(deviations));
+            }
+
+            double ns_per_element() const
+            {
+                return median_ns() / elements;
+            }
+
+            double elements_per_second() const
+            {
+                return 1e9 / ns_per_element();
+            }
+        };
+
+        struct registrar
+        {
+            registrar(std::string name, size_t elements, body fn)
+            {
+                cases().push_back(bench_case{ std::move(name), elements, std::move(fn) });
+            }
+        };
+    }
+}
@@ -0,0 +1,56 @@
+#include "bench.hpp"
+#include <plusar/any_stream.hpp>
+#include <array>
+
+using namespace plusar;
+
+// Cost of type erasure per element, against the same pipeline of concrete type
+namespace
+{
+    constexpr size_t N = 1 << 20;
+
+    auto pipeline(size_t n)
+    {
+        return make_range(uint64_t{ 0 }, uint64_t{ n })
+                .map([](uint64_t v) { return v * 3; })
+                .filter([](uint64_t v) { return v & 4; });
+    }
+
+    template<typename S>
+    uint64_t drain(S const &s)
+    {
+        uint64_t sum = 0;
+        for(auto v = s.next(); v; v = s.next())
+            sum += *v;
+        return sum;
+    }
+
+    template<typename S>
+    uint64_t drain_batches(S const &s)
+    {
+        uint64_t buffer[256];
+        uint64_t sum = 0;
+        for(size_t n = s.next_batch(buffer, 256); n; n = s.next_batch(buffer, 256))
+            for(size_t i = 0; i < n; ++i)
+                sum += buffer[i];
+        return sum;
+    }
+
+    bench::registrar concrete("any_stream/concrete", N, [](size_t n) { return drain(pipeline(n)); });
+
+    bench::registrar erased("any_stream/erased", N, [](size_t n)
+    {
+        return drain(make_any_stream<uint64_t>(pipeline(n)));
+    });
+
+    bench::registrar erased_batches("any_stream/erased.next_batch", N, [](size_t n)
+    {
+        return drain_batches(make_any_stream<uint64_t>(pipeline(n)));
+    });
+
+    // The pipeline doesn't fit the inline storage
+    bench::registrar erased_heap("any_stream/erased(heap)", N, [](size_t n)
+    {
+        return drain(make_any_stream<uint64_t>(pipeline(n).map([pad = std::array<uint64_t, 16>{}](uint64_t v) { return v + pad[v & 15]; })));
+    });
+}
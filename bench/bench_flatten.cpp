@@ -0,0 +1,88 @@
+#include "bench.hpp"
+#include <plusar/stream.hpp>
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace plusar;
+
+// 1M short inner streams, each capturing a heap allocated string, as a tokenizer would
+namespace
+{
+    constexpr size_t N = 1 << 20;
+    constexpr size_t inner = 4;
+
+    std::string const tag(40, 't');     // longer than the small string buffer
+
+    auto inner_stream(size_t i)
+    {
+        return make_range(i * inner, (i + 1) * inner).map([tag = tag](size_t v) { return v + tag.size(); });
+    }
+
+    template<typename S>
+    uint64_t drain(S const &s)
+    {
+        uint64_t sum = 0;
+        for(auto v = s.next(); v; v = s.next())
+            sum += *v;
+        return sum;
+    }
+
+    // The former flatten, which copy-constructed every inner stream into its slot
+    template<typename S>
+    auto copying_flatten(S const &src)
+    {
+        using inner_t = typename S::type;
+
+        return make_stream([src, current = std::make_shared<std::optional<inner_t>>()]() -> std::optional<typename inner_t::type>
+        {
+            for(;;)
+            {
+                if (*current)
+                {
+                    if (auto v = (*current)->next())
+                        return v;
+                }
+
+                auto const next = src.next();
+                if (!next)
+                    return std::nullopt;
+                current->reset();
+                current->emplace(*next);
+            }
+        });
+    }
+
+    bench::registrar flatten_copy("flatten(1M x 4)/copy", N, [](size_t n)
+    {
+        return drain(copying_flatten(make_range(size_t{ 0 }, n / inner).map(inner_stream)));
+    });
+
+    bench::registrar flatten_move("flatten(1M x 4)/move", N, [](size_t n)
+    {
+        return drain(make_range(size_t{ 0 }, n / inner).map(inner_stream).flatten());
+    });
+
+    bench::registrar flat_map_stream("flatten(1M x 4)/flat_map", N, [](size_t n)
+    {
+        return drain(make_range(size_t{ 0 }, n / inner).flat_map(inner_stream));
+    });
+
+    bench::registrar flat_map_buffer("flatten(1M x 4)/flat_map<buffer>", N, [](size_t n)
+    {
+        return drain(make_range(size_t{ 0 }, n / inner).flat_map<size_t>([](size_t i, std::vector<size_t> &out)
+        {
+            for(size_t v = i * inner; v < (i + 1) * inner; ++v)
+                out.push_back(v + tag.size());
+        }));
+    });
+
+    bench::registrar flatten_loop("flatten(1M x 4)/loop", N, [](size_t n)
+    {
+        uint64_t sum = 0;
+        for(size_t i = 0; i < n / inner; ++i)
+            for(size_t v = i * inner; v < (i + 1) * inner; ++v)
+                sum += v + tag.size();
+        return sum;
+    });
+}
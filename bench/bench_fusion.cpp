@@ -0,0 +1,74 @@
+#include "bench.hpp"
+#include <plusar/stream.hpp>
+
+using namespace plusar;
+
+namespace
+{
+    constexpr size_t N = 1 << 22;
+
+    auto counter()
+    {
+        return make_stream([n = internal::mutable_idx{}]() { return std::make_optional<uint64_t>(n.value++); });
+    }
+
+    // Opaque stage wrappers reproducing the nested closure layout the fused operators replace
+    template<typename S, typename F>
+    auto unfused_map(S const &s, F f)
+    {
+        return make_stream([src = s, f]()
+        {
+            auto sv = src.next();
+            return sv ? std::make_optional(f(*sv)) : std::nullopt;
+        });
+    }
+
+    template<typename S, typename P>
+    auto unfused_filter(S const &s, P pred)
+    {
+        return make_stream([src = s, pred]() -> std::optional<typename S::type>
+        {
+            for(auto sv = src.next(); sv; sv = src.next())
+                if(pred(*sv))
+                    return sv;
+            return std::nullopt;
+        });
+    }
+
+    auto const inc = [](uint64_t v) { return v + 1; };
+    auto const mul = [](uint64_t v) { return v * 3; };
+    auto const odd = [](uint64_t v) { return (v & 1) != 0; };
+    auto const not7 = [](uint64_t v) { return v % 7 != 0; };
+
+    auto fused_chain(size_t n)
+    {
+        return counter()
+                .take(n)
+                .map(inc).map(mul).map(inc).map(mul)
+                .filter(odd).filter(not7);
+    }
+
+    auto unfused_chain(size_t n)
+    {
+        return unfused_filter(unfused_filter(unfused_map(unfused_map(unfused_map(unfused_map(counter().take(n), inc), mul), inc), mul), odd), not7);
+    }
+
+    template<typename S>
+    uint64_t drain(S const &s)
+    {
+        uint64_t sum = 0;
+        for(auto v = s.next(); v; v = s.next())
+            sum += *v;
+        return sum;
+    }
+
+    bench::registrar fused("fusion/map4.filter2/fused", N, [](size_t n) { return drain(fused_chain(n)); });
+    bench::registrar unfused("fusion/map4.filter2/unfused", N, [](size_t n) { return drain(unfused_chain(n)); });
+
+    bench::registrar take_fused("fusion/take8/fused", N, [](size_t n)
+    {
+        return drain(counter().take(n).take(n).take(n).take(n).take(n).take(n).take(n).take(n));
+    });
+
+    static_assert(sizeof(decltype(fused_chain(0))) < sizeof(decltype(unfused_chain(0))), "fused stages are expected to be smaller");
+}
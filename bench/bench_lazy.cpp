@@ -0,0 +1,43 @@
+#include "bench.hpp"
+#include <plusar/stream.hpp>
+#include <cmath>
+
+using namespace plusar;
+
+namespace
+{
+    constexpr size_t N = 1 << 20;
+
+    // Stands in for an expensive decoder
+    uint64_t decode(uint64_t v)
+    {
+        double x = static_cast<double>(v);
+        for(int i = 0; i < 16; ++i)
+            x = std::sqrt(x + i);
+        return static_cast<uint64_t>(x);
+    }
+
+    auto counter()
+    {
+        return make_stream([n = internal::mutable_idx{}]() { return std::make_optional<uint64_t>(n.value++); });
+    }
+
+    template<typename S>
+    uint64_t drain(S const &s)
+    {
+        uint64_t sum = 0;
+        for(auto v = s.next(); v; v = s.next())
+            sum += *v;
+        return sum;
+    }
+
+    bench::registrar strided_pure("lazy/map.slice(step=10)/pure", N, [](size_t n)
+    {
+        return drain(counter().map(pure(decode)).slice(0, n, 10));
+    });
+
+    bench::registrar strided_impure("lazy/map.slice(step=10)/impure", N, [](size_t n)
+    {
+        return drain(counter().map(decode).slice(0, n, 10));
+    });
+}
@@ -0,0 +1,41 @@
+#include "bench.hpp"
+#include <plusar/memory.hpp>
+#include <plusar/tee.hpp>
+#include <memory_resource>
+#include <cstdint>
+
+using namespace plusar;
+
+// Two branches of a tee over 1M elements in chunks of 16, a chunk and its control block allocated per 16 elements
+namespace
+{
+    constexpr size_t N = 1 << 20;
+
+    uint64_t drain_tee(size_t n, std::pmr::memory_resource *resource)
+    {
+        auto branches = make_range(uint64_t{ 0 }, uint64_t{ n }).tee(2, 16, resource);
+        uint64_t sum = 0;
+        for(size_t i = 0; i < n; ++i)
+            sum += *branches[0].next() + *branches[1].next();
+        return sum;
+    }
+
+    bench::registrar tee_default("tee(2, 16)/new_delete", N, [](size_t n)
+    {
+        return drain_tee(n, std::pmr::new_delete_resource());
+    });
+
+    bench::registrar tee_pool("tee(2, 16)/thread_local_pool", N, [](size_t n)
+    {
+        return drain_tee(n, thread_local_pool());
+    });
+
+    // The arena is reset after every run, as it would be when a window fires
+    bench::registrar tee_arena("tee(2, 16)/arena", N, [](size_t n)
+    {
+        static arena a;
+        uint64_t const sum = drain_tee(n, &a);
+        a.reset();
+        return sum;
+    });
+}
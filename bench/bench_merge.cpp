@@ -0,0 +1,80 @@
+#include "bench.hpp"
+#include <plusar/merge.hpp>
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+using namespace plusar;
+
+// 16 sorted shards of 64K timestamps merged into one ordered stream
+namespace
+{
+    constexpr size_t N = 1 << 20;
+    constexpr size_t shards = 16;
+
+    std::vector<std::vector<uint64_t>> const & input()
+    {
+        static std::vector<std::vector<uint64_t>> const data = []()
+        {
+            std::vector<std::vector<uint64_t>> v(shards);
+            uint64_t x = 12345;
+            for(size_t i = 0; i < N; ++i)
+            {
+                x = x * 6364136223846793005u + 1442695040888963407u;
+                v[(x >> 33) % shards].push_back(i);
+            }
+            return v;
+        }();
+        return data;
+    }
+
+    bench::registrar merge_plusar("merge_sorted(16)/plusar", N, [](size_t)
+    {
+        std::vector<decltype(make_stream(input()[0]))> inputs;
+        for(auto const &shard : input())
+            inputs.push_back(make_stream(shard));
+
+        auto const s = merge_sorted(inputs);
+        uint64_t sum = 0, i = 0;
+        for(auto v = s.next(); v; v = s.next())
+            sum += *v ^ i++;
+        return sum;
+    });
+
+    bench::registrar merge_heap("merge_sorted(16)/std::priority_queue", N, [](size_t)
+    {
+        using head = std::pair<uint64_t, size_t>;
+        std::priority_queue<head, std::vector<head>, std::greater<>> heap;
+        std::vector<size_t> pos(shards);
+        for(size_t s = 0; s < shards; ++s)
+            if (!input()[s].empty())
+                heap.push({ input()[s][0], s });
+
+        uint64_t sum = 0, i = 0;
+        while(!heap.empty())
+        {
+            auto const [v, s] = heap.top();
+            heap.pop();
+            sum += v ^ i++;
+            if (++pos[s] < input()[s].size())
+                heap.push({ input()[s][pos[s]], s });
+        }
+        return sum;
+    });
+
+    bench::registrar merge_sort("merge_sorted(16)/collect.std::sort", N, [](size_t)
+    {
+        std::vector<uint64_t> all;
+        all.reserve(N);
+        for(auto const &shard : input())
+            all.insert(all.end(), shard.begin(), shard.end());
+        std::sort(all.begin(), all.end());
+
+        uint64_t sum = 0, i = 0;
+        for(auto v : all)
+            sum += v ^ i++;
+        return sum;
+    });
+}
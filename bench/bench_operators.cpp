@@ -0,0 +1,219 @@
+#include "bench.hpp"
+#include <plusar/stream.hpp>
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+// Every operator measured against a hand-written loop and, where one exists, an <algorithm> equivalent
+using namespace plusar;
+
+namespace
+{
+    constexpr size_t N = 1 << 20;
+
+    std::vector<uint32_t> const & input()
+    {
+        static std::vector<uint32_t> const data = []()
+        {
+            std::vector<uint32_t> v(N);
+            uint32_t x = 12345;
+            for(auto &e : v)
+                e = x = x * 1664525u + 1013904223u;
+            return v;
+        }();
+        return data;
+    }
+
+    // Copies of a stream share the container
+    auto source()
+    {
+        static auto const s = make_stream(input());
+        return s;
+    }
+
+    template<typename S>
+    uint64_t drain(S const &s)
+    {
+        uint64_t sum = 0;
+        for(auto v = s.next(); v; v = s.next())
+            sum += *v;
+        return sum;
+    }
+
+    auto const mul = [](uint32_t v) { return uint64_t{ v } * 3 + 1; };
+    auto const odd = [](uint32_t v) { return (v & 1) != 0; };
+
+    std::vector<uint32_t> & scratch()
+    {
+        static std::vector<uint32_t> buffer(N);
+        return buffer;
+    }
+
+    // map
+    bench::registrar map_plusar("operator/map/plusar", N, [](size_t) { return drain(source().map(mul)); });
+    bench::registrar map_loop("operator/map/loop", N, [](size_t)
+    {
+        uint64_t sum = 0;
+        for(auto v : input())
+            sum += mul(v);
+        return sum;
+    });
+    bench::registrar map_std("operator/map/std::transform_reduce", N, [](size_t)
+    {
+        return std::transform_reduce(input().begin(), input().end(), uint64_t{ 0 }, std::plus<>(), mul);
+    });
+
+    // filter
+    bench::registrar filter_plusar("operator/filter/plusar", N, [](size_t) { return drain(source().filter(odd)); });
+    bench::registrar filter_loop("operator/filter/loop", N, [](size_t)
+    {
+        uint64_t sum = 0;
+        for(auto v : input())
+            if (odd(v))
+                sum += v;
+        return sum;
+    });
+    bench::registrar filter_std("operator/filter/std::copy_if", N, [](size_t)
+    {
+        auto end = std::copy_if(input().begin(), input().end(), scratch().begin(), odd);
+        return std::accumulate(scratch().begin(), end, uint64_t{ 0 });
+    });
+
+    // reduce
+    bench::registrar reduce_plusar("operator/reduce/plusar", N, [](size_t)
+    {
+        return source().reduce(uint64_t{ 0 }, std::plus<>()).collect();
+    });
+    bench::registrar reduce_loop("operator/reduce/loop", N, [](size_t)
+    {
+        uint64_t sum = 0;
+        for(auto v : input())
+            sum += v;
+        return sum;
+    });
+    bench::registrar reduce_std("operator/reduce/std::accumulate", N, [](size_t)
+    {
+        return std::accumulate(input().begin(), input().end(), uint64_t{ 0 });
+    });
+
+    // take and skip
+    bench::registrar take_plusar("operator/take/plusar", N / 2, [](size_t n) { return drain(source().take(n)); });
+    bench::registrar take_loop("operator/take/loop", N / 2, [](size_t n)
+    {
+        uint64_t sum = 0;
+        for(size_t i = 0; i < n; ++i)
+            sum += input()[i];
+        return sum;
+    });
+    bench::registrar skip_plusar("operator/skip/plusar", N / 2, [](size_t n) { return drain(source().skip(N - n)); });
+    bench::registrar skip_loop("operator/skip/loop", N / 2, [](size_t n)
+    {
+        uint64_t sum = 0;
+        for(size_t i = N - n; i < N; ++i)
+            sum += input()[i];
+        return sum;
+    });
+
+    // slice
+    bench::registrar slice_plusar("operator/slice(step=4)/plusar", N / 4, [](size_t) { return drain(source().slice(0, N, 4)); });
+    bench::registrar slice_loop("operator/slice(step=4)/loop", N / 4, [](size_t)
+    {
+        uint64_t sum = 0;
+        for(size_t i = 0; i < N; i += 4)
+            sum += input()[i];
+        return sum;
+    });
+
+    // zip
+    bench::registrar zip_plusar("operator/zip/plusar", N, [](size_t)
+    {
+        return drain(source().zip(source().skip(1), [](uint32_t a, uint32_t b) { return uint64_t{ a } ^ b; }));
+    });
+    bench::registrar zip_loop("operator/zip/loop", N, [](size_t)
+    {
+        uint64_t sum = 0;
+        for(size_t i = 0; i + 1 < N; ++i)
+            sum += uint64_t{ input()[i] } ^ input()[i + 1];
+        return sum;
+    });
+    bench::registrar zip_std("operator/zip/std::transform_reduce", N, [](size_t)
+    {
+        return std::transform_reduce(input().begin(), input().end() - 1, input().begin() + 1, uint64_t{ 0 }, std::plus<>(),
+                                     [](uint32_t a, uint32_t b) { return uint64_t{ a } ^ b; });
+    });
+
+    // flatten
+    constexpr size_t inner = 64;
+
+    bench::registrar flatten_plusar("operator/flatten(64)/plusar", N, [](size_t n)
+    {
+        return drain(make_range(size_t{ 0 }, n / inner)
+                        .map([](size_t i) { return make_range(i * inner, (i + 1) * inner); })
+                        .flatten());
+    });
+    bench::registrar flatten_loop("operator/flatten(64)/loop", N, [](size_t n)
+    {
+        uint64_t sum = 0;
+        for(size_t i = 0; i < n / inner; ++i)
+            for(size_t j = i * inner; j < (i + 1) * inner; ++j)
+                sum += j;
+        return sum;
+    });
+
+    // chunk: sum of every group of 64 elements
+    constexpr size_t group = 64;
+
+    template<typename C>
+    uint64_t sum_chunks(C const &chunks)
+    {
+        uint64_t sum = 0;
+        for(auto c = chunks.next(); c; c = chunks.next())
+            sum += std::accumulate(c->begin(), c->end(), uint64_t{ 0 });
+        return sum;
+    }
+
+    bench::registrar chunk_plusar("operator/chunk(64)/plusar", N, [](size_t) { return sum_chunks(source().chunk(group)); });
+    bench::registrar chunk_vector_plusar("operator/chunk(64)/plusar.chunk_vector", N, [](size_t) { return sum_chunks(source().chunk_vector(group)); });
+    bench::registrar chunk_loop("operator/chunk(64)/loop", N, [](size_t)
+    {
+        auto const &v = input();
+        uint64_t sum = 0;
+        for(size_t i = 0; i < v.size(); i += group)
+            sum += std::accumulate(v.begin() + i, v.begin() + std::min(v.size(), i + group), uint64_t{ 0 });
+        return sum;
+    });
+
+    // representative chain
+    bench::registrar chain_plusar("chain/map.filter.take.reduce/plusar", N, [](size_t n)
+    {
+        return source()
+                .map(mul)
+                .filter([](uint64_t v) { return v % 3 != 0; })
+                .take(n)
+                .reduce(uint64_t{ 0 }, std::plus<>())
+                .collect();
+    });
+    bench::registrar chain_loop("chain/map.filter.take.reduce/loop", N, [](size_t n)
+    {
+        uint64_t sum = 0;
+        size_t taken = 0;
+        for(auto v : input())
+        {
+            auto m = mul(v);
+            if (m % 3 == 0)
+                continue;
+            if (taken++ == n)
+                break;
+            sum += m;
+        }
+        return sum;
+    });
+    bench::registrar chain_std("chain/map.filter.take.reduce/std", N, [](size_t n)
+    {
+        static std::vector<uint64_t> mapped(N);
+        std::transform(input().begin(), input().end(), mapped.begin(), mul);
+        auto end = std::remove_if(mapped.begin(), mapped.end(), [](uint64_t v) { return v % 3 == 0; });
+        end = mapped.begin() + std::min<size_t>(n, end - mapped.begin());
+        return std::accumulate(mapped.begin(), end, uint64_t{ 0 });
+    });
+}
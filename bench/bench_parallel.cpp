@@ -0,0 +1,39 @@
+#include "bench.hpp"
+#include <plusar/parallel.hpp>
+#include <cmath>
+
+using namespace plusar;
+
+namespace
+{
+    constexpr size_t N = 1 << 16;
+
+    // CPU heavy element function, stands in for a JSON decoder
+    uint64_t heavy(uint64_t v)
+    {
+        double x = static_cast<double>(v);
+        for(int i = 0; i < 256; ++i)
+            x = std::sqrt(x + i);
+        return static_cast<uint64_t>(x);
+    }
+
+    bench::registrar sequential("parallel/map/sequential", N, [](size_t n)
+    {
+        return make_range(uint64_t{ 0 }, uint64_t{ n }).map(heavy).sum();
+    });
+
+    bench::registrar ordered("parallel/parallel_map/ordered", N, [](size_t n)
+    {
+        return make_range(uint64_t{ 0 }, uint64_t{ n }).parallel_map(heavy).sum();
+    });
+
+    bench::registrar unordered("parallel/parallel_map/unordered", N, [](size_t n)
+    {
+        return make_range(uint64_t{ 0 }, uint64_t{ n }).parallel_map_unordered(heavy).sum();
+    });
+
+    bench::registrar reduce("parallel/parallel_reduce", N, [](size_t n)
+    {
+        return parallel_reduce(make_range(uint64_t{ 0 }, uint64_t{ n }).map(heavy), uint64_t{ 0 }, std::plus<>(), std::plus<>());
+    });
+}
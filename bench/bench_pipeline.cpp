@@ -0,0 +1,64 @@
+#include "bench.hpp"
+#include <plusar/pipeline.hpp>
+
+using namespace plusar;
+
+// Configured pipelines against the same chains written as templates
+namespace
+{
+    constexpr size_t N = 1 << 20;
+
+    auto source(size_t n)
+    {
+        return make_range(int64_t{ 0 }, static_cast<int64_t>(n)).map([](int64_t v) { return (v * 7919) % 1000; });
+    }
+
+    char const filter_map_sum[] = R"([
+        { "op": "filter", "cmp": "gt", "value": 100 },
+        { "op": "map", "fn": "mul", "value": 3 },
+        { "op": "aggregate", "fn": "sum" }
+    ])";
+
+    char const window_mean[] = R"([
+        { "op": "cast", "to": "double" },
+        { "op": "aggregate", "fn": "mean", "window": 64 }
+    ])";
+
+    bench::registrar template_chain("pipeline/filter.map.sum/template", N, [](size_t n)
+    {
+        return static_cast<uint64_t>(source(n)
+                                        .filter([](int64_t v) { return v > 100; })
+                                        .map([](int64_t v) { return v * 3; })
+                                        .reduce(int64_t{ 0 }, std::plus<>())
+                                        .collect());
+    });
+
+    bench::registrar configured_chain("pipeline/filter.map.sum/configured", N, [](size_t n)
+    {
+        return static_cast<uint64_t>(make_pipeline<int64_t>(source(n), filter_map_sum).collect());
+    });
+
+    bench::registrar template_windows("pipeline/cast.mean(window=64)/template", N, [](size_t n)
+    {
+        auto const s = source(n);
+        double sum = 0;
+        for(auto v = s.next(); v;)
+        {
+            double w = 0;
+            size_t k = 0;
+            for(; v && k < 64; ++k, v = s.next())
+                w += static_cast<double>(*v);
+            sum += w / k;
+        }
+        return static_cast<uint64_t>(sum);
+    });
+
+    bench::registrar configured_windows("pipeline/cast.mean(window=64)/configured", N, [](size_t n)
+    {
+        auto const s = make_pipeline<double>(source(n), window_mean);
+        double sum = 0;
+        for(auto v = s.next(); v; v = s.next())
+            sum += *v;
+        return static_cast<uint64_t>(sum);
+    });
+}
@@ -0,0 +1,85 @@
+#include "bench.hpp"
+#include <plusar/sort.hpp>
+#include <plusar/generate.hpp>
+#include <plusar/parallel.hpp>
+#include <algorithm>
+#include <utility>
+#include <map>
+#include <vector>
+
+using namespace plusar;
+
+// Uniformly distributed 64-bit keys
+namespace
+{
+    constexpr size_t N = 1 << 20;
+
+    std::vector<uint64_t> const & input(size_t n = N)
+    {
+        static std::map<size_t, std::vector<uint64_t>> data;
+        auto &v = data[n];
+        if (v.empty())
+            gen::uniform(UINT64_MAX, n, 1).collect(std::back_inserter(v));
+        return v;
+    }
+
+    template<typename It>
+    uint64_t checksum(It first, It last)
+    {
+        uint64_t sum = 0, i = 0;
+        for(; first != last; ++first)
+            sum += *first * ++i;
+        return sum;
+    }
+
+    uint64_t std_sort(size_t n)
+    {
+        std::vector<uint64_t> v = input(n);
+        std::sort(v.begin(), v.end());
+        return checksum(v.begin(), v.end());
+    }
+
+    // Compared as a pair, so it's merge sorted
+    auto const halves = [](uint64_t v) { return std::make_pair(static_cast<uint32_t>(v >> 32), static_cast<uint32_t>(v)); };
+
+    template<typename S>
+    uint64_t drain(S const &s)
+    {
+        uint64_t sum = 0, i = 0;
+        for(auto v = s.next(); v; v = s.next())
+            sum += *v * ++i;
+        return sum;
+    }
+
+    bench::registrar sort_memory("sort(1M)/plusar", N, [](size_t)
+    {
+        return drain(make_stream(input()).sort());
+    });
+
+    bench::registrar sort_external("sort(1M)/plusar.budget(1MB)", N, [](size_t)
+    {
+        return drain(make_stream(input()).sort(std::less<>(), 1 << 20));
+    });
+
+    bench::registrar sort_std("sort(1M)/std::sort", N, std_sort);
+
+    // sorted() on thread_pool::shared() against std::sort on a single thread. Larger inputs only take a bigger n,
+    // the suite stops at 16M elements to fit in the memory of a CI runner.
+    constexpr size_t M16 = 1 << 24;
+
+    template<typename Key>
+    uint64_t sorted(size_t n, Key key, bool stable = false)
+    {
+        auto v = make_stream(input(n)).sorted(key, stable);
+        return checksum(v.begin(), v.end());
+    }
+
+    bench::registrar sorted_radix("sorted(1M)/plusar.radix", N, [](size_t n) { return sorted(n, [](uint64_t v) { return v; }); });
+    bench::registrar sorted_merge("sorted(1M)/plusar.merge", N, [](size_t n) { return sorted(n, halves); });
+    bench::registrar sorted_stable("sorted(1M)/plusar.merge.stable", N, [](size_t n) { return sorted(n, halves, true); });
+    bench::registrar sorted_std("sorted(1M)/std::sort", N, std_sort);
+
+    bench::registrar sorted_radix_16m("sorted(16M)/plusar.radix", M16, [](size_t n) { return sorted(n, [](uint64_t v) { return v; }); });
+    bench::registrar sorted_merge_16m("sorted(16M)/plusar.merge", M16, [](size_t n) { return sorted(n, halves); });
+    bench::registrar sorted_std_16m("sorted(16M)/std::sort", M16, std_sort);
+}
@@ -0,0 +1,177 @@
+#include "bench.hpp"
+#include "baseline.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+using namespace plusar::bench;
+
+namespace
+{
+    volatile uint64_t sink;
+
+    double run_once(bench_case const &c)
+    {
+        auto start = std::chrono::steady_clock::now();
+        sink = c.fn(c.elements);
+        auto stop = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::nano>(stop - start).count();
+    }
+
+    void usage()
+    {
+        std::cerr << "usage: plusar-bench [options]\n"
+                     "  --filter <text>       run benchmarks whose name contains the text\n"
+                     "  --repetitions <n>     measured runs per benchmark (default 5)\n"
+                     "  --json <file>         write results as JSON, '-' for stdout\n"
+                     "  --save <file>         the same as --json <file>, the output serves as a baseline\n"
+                     "  --compare <file>      compare with a baseline, exit with 1 on a regression\n"
+                     "  --threshold <pct>     slowdown tolerated before a regression is reported (default 5)\n"
+                     "  --list                list benchmark names\n";
+    }
+
+    void write_json(std::ostream &os, std::vector<result> const &results)
+    {
+        os << "{\n  \"benchmarks\": [";
+        for(size_t i = 0; i < results.size(); ++i)
+        {
+            auto const &r = results[i];
+            os << (i ? ",\n" : "\n")
+               << "    {\"name\": \"" << r.name << "\""
+               << ", \"elements\": " << r.elements
+               << ", \"ns_per_element\": " << r.ns_per_element()
+               << ", \"elements_per_second\": " << r.elements_per_second()
+               << ", \"median_ns\": " << r.median_ns()
+               << ", \"mad_ns\": " << r.mad_ns()
+               << ", \"samples_ns\": [";
+            for(size_t j = 0; j < r.samples_ns.size(); ++j)
+                os << (j ? ", " : "") << r.samples_ns[j];
+            os << "]}";
+        }
+        os << "\n  ]\n}\n";
+    }
+
+    // Prints the comparison and returns the number of regressions
+    size_t report(FILE *out, std::vector<result> const &baseline, std::vector<result> const &results, double threshold)
+    {
+        std::fprintf(out, "\n%-52s %12s %12s %9s %8s  %s\n", "benchmark", "base ns/el", "ns/el", "change", "noise", "status");
+
+        size_t regressions = 0;
+
+        for(auto const &r : results)
+        {
+            auto base = std::find_if(baseline.begin(), baseline.end(), [&](result const &b) { return b.name == r.name; });
+            auto const c = compare(base != baseline.end() ? &*base : nullptr, r, threshold);
+
+            if (c.status == verdict::added)
+                std::fprintf(out, "%-52s %12s %12.3f %9s %8s  %s\n", c.name.c_str(), "-", c.current_ns, "-", "-", to_string(c.status));
+            else
+                std::fprintf(out, "%-52s %12.3f %12.3f %+8.1f%% %7.1f%%  %s\n", c.name.c_str(), c.baseline_ns, c.current_ns,
+                            100 * c.change, 100 * c.noise, to_string(c.status));
+
+            regressions += c.status == verdict::regressed;
+        }
+
+        if (regressions)
+            std::fprintf(out, "%zu benchmark(s) regressed by more than %.1f%%\n", regressions, 100 * threshold);
+
+        return regressions;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::string filter;
+    std::string json;
+    std::string baseline_path;
+    int repetitions = 5;
+    double threshold = 0.05;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        bool const has_value = i + 1 < argc;
+
+        if (!std::strcmp(argv[i], "--filter") && has_value)
+            filter = argv[++i];
+        else if (!std::strcmp(argv[i], "--repetitions") && has_value)
+            repetitions = std::max(1, std::atoi(argv[++i]));
+        else if ((!std::strcmp(argv[i], "--json") || !std::strcmp(argv[i], "--save")) && has_value)
+            json = argv[++i];
+        else if (!std::strcmp(argv[i], "--compare") && has_value)
+            baseline_path = argv[++i];
+        else if (!std::strcmp(argv[i], "--threshold") && has_value)
+            threshold = std::atof(argv[++i]) / 100;
+        else if (!std::strcmp(argv[i], "--list"))
+        {
+            for(auto const &c : cases())
+                std::cout << c.name << '\n';
+            return 0;
+        }
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+
+    std::vector<result> baseline;
+    if (!baseline_path.empty())
+    {
+        try
+        {
+            baseline = load_results(baseline_path);
+        }
+        catch(std::exception const &e)
+        {
+            std::cerr << e.what() << '\n';
+            return 2;
+        }
+    }
+
+    bool const table = json != "-";
+    if (table)
+        std::printf("%-52s %14s %16s\n", "benchmark", "ns/element", "elements/s");
+
+    std::vector<result> results;
+
+    for(auto const &c : cases())
+    {
+        if (c.name.find(filter) == std::string::npos)
+            continue;
+
+        run_once(c);    // warm up
+
+        result r{ c.name, c.elements, {} };
+        for(int i = 0; i < repetitions; ++i)
+            r.samples_ns.push_back(run_once(c));
+
+        if (table)
+            std::printf("%-52s %14.3f %16.0f\n", r.name.c_str(), r.ns_per_element(), r.elements_per_second());
+
+        results.push_back(std::move(r));
+    }
+
+    if (json == "-")
+        write_json(std::cout, results);
+    else if (!json.empty())
+    {
+        std::ofstream file(json);
+        write_json(file, results);
+        if (!file)
+        {
+            std::cerr << "can't write " << json << '\n';
+            return 1;
+        }
+    }
+
+    // the comparison goes to stderr when stdout carries JSON
+    if (!baseline_path.empty())
+        return report(table ? stdout : stderr, baseline, results, threshold) ? 1 : 0;
+
+    return 0;
+}
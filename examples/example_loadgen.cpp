@@ -0,0 +1,137 @@
+#include <plusar/generate.hpp>
+#include <algorithm>
+#include <functional>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Writes a reproducible stream of 'timestamp key payload' lines, or a summary of it
+namespace
+{
+    struct event
+    {
+        uint64_t    timestamp;      // ns
+        uint64_t    key;
+        std::string payload;
+    };
+
+    void usage()
+    {
+        std::cerr << "usage: plusar-loadgen [options]\n"
+                     "  --events <n>                 number of events (default 1000000)\n"
+                     "  --keys <n>                   key space (default 1000)\n"
+                     "  --zipf <exponent>            Zipfian keys, uniform if omitted\n"
+                     "  --rate <events/s>            mean arrival rate, Poisson arrivals (default 100000)\n"
+                     "  --burst <rate> <size>        bursty arrivals: bursts of 'size' events at 'rate' events/s\n"
+                     "  --payload <min> <max>        payload size range in bytes (default 16 64)\n"
+                     "  --seed <n>                   seed of the generators (default 0)\n"
+                     "  --summary                    print statistics instead of the events\n";
+    }
+
+    template<typename Times, typename Keys>
+    int run(Times times, Keys keys, size_t min_payload, size_t max_payload, size_t events, uint64_t seed, bool summary)
+    {
+        auto s = std::move(times)
+                    .zip(std::move(keys), [](uint64_t t, uint64_t k) { return std::make_pair(t, k); })
+                    .zip(plusar::gen::payload(min_payload, max_payload, events, seed + 2),
+                         [](std::pair<uint64_t, uint64_t> tk, std::string p) { return event{ tk.first, tk.second, std::move(p) }; });
+
+        if (!summary)
+        {
+            for(auto e = s.next(); e; e = s.next())
+                std::printf("%llu %llu %s\n", static_cast<unsigned long long>(e->timestamp), static_cast<unsigned long long>(e->key), e->payload.c_str());
+            return 0;
+        }
+
+        std::vector<size_t> counts;
+        size_t n = 0, bytes = 0;
+        uint64_t last = 0;
+        for(auto e = s.next(); e; e = s.next())
+        {
+            if (e->key >= counts.size())
+                counts.resize(e->key + 1);
+            ++counts[e->key];
+            ++n;
+            bytes += e->payload.size();
+            last = e->timestamp;
+        }
+
+        std::sort(counts.begin(), counts.end(), std::greater<>());
+        size_t hot = 0;
+        for(size_t i = 0; i < std::min<size_t>(10, counts.size()); ++i)
+            hot += counts[i];
+
+        std::printf("events:            %zu\n", n);
+        std::printf("span:              %.3f s\n", last / 1e9);
+        std::printf("rate:              %.0f events/s\n", last ? n / (last / 1e9) : 0.0);
+        std::printf("payload bytes:     %zu\n", bytes);
+        std::printf("top 10 keys share: %.1f%%\n", n ? 100.0 * hot / n : 0.0);
+        return 0;
+    }
+
+    template<typename Times>
+    int run(Times times, uint64_t keys, double zipf, size_t min_payload, size_t max_payload, size_t events, uint64_t seed, bool summary)
+    {
+        if (zipf > 0)
+            return run(std::move(times), plusar::gen::zipf(keys, zipf, events, seed + 1), min_payload, max_payload, events, seed, summary);
+        return run(std::move(times), plusar::gen::uniform(keys, events, seed + 1), min_payload, max_payload, events, seed, summary);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t events = 1000000;
+    uint64_t keys = 1000;
+    double zipf = 0;
+    double rate = 100000;
+    double burst_rate = 0, burst_size = 0;
+    size_t min_payload = 16, max_payload = 64;
+    uint64_t seed = 0;
+    bool summary = false;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        int const values = argc - i - 1;
+
+        if (!std::strcmp(argv[i], "--events") && values >= 1)
+            events = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--keys") && values >= 1)
+            keys = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--zipf") && values >= 1)
+            zipf = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--rate") && values >= 1)
+            rate = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--burst") && values >= 2)
+        {
+            burst_rate = std::atof(argv[++i]);
+            burst_size = std::atof(argv[++i]);
+        }
+        else if (!std::strcmp(argv[i], "--payload") && values >= 2)
+        {
+            min_payload = std::strtoull(argv[++i], nullptr, 10);
+            max_payload = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (!std::strcmp(argv[i], "--seed") && values >= 1)
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--summary"))
+            summary = true;
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+
+    if (rate <= 0 || keys == 0)
+    {
+        usage();
+        return 2;
+    }
+
+    if (burst_size > 0)
+        return run(plusar::gen::bursty(rate, burst_rate, burst_size, events, seed), keys, zipf, min_payload, max_payload, events, seed, summary);
+    return run(plusar::gen::poisson(rate, events, seed), keys, zipf, min_payload, max_payload, events, seed, summary);
+}
@@ -0,0 +1,189 @@
+#pragma once
+#include <optional>
+#include <functional>
+#include <utility>
+#include <cstddef>
+#include <cmath>
+#include <tuple>
+
+// Accumulators for stream<Fn>::aggregate
+namespace plusar::agg
+{
+    namespace internal
+    {
+        struct count_acc
+        {
+            size_t n = 0;
+
+            template<typename T>
+            void push(T const &)
+            {
+                ++n;
+            }
+
+            size_t result() const
+            {
+                return n;
+            }
+        };
+
+        template<typename T>
+        struct sum_acc
+        {
+            T value{};
+
+            void push(T const &v)
+            {
+                value = value + v;
+            }
+
+            T result() const
+            {
+                return value;
+            }
+        };
+
+        template<typename T, typename Compare>
+        struct min_acc
+        {
+            Compare cmp;
+            std::optional<T> value = std::nullopt;
+
+            void push(T const &v)
+            {
+                if (!value || cmp(v, *value))
+                    value = v;
+            }
+
+            std::optional<T> result() const
+            {
+                return value;
+            }
+        };
+
+        // Online mean: m(n) = m(n-1) + (x - m(n-1)) / n
+        struct mean_acc
+        {
+            size_t n = 0;
+            double mean = 0;
+
+            template<typename T>
+            void push(T const &v)
+            {
+                mean += (static_cast<double>(v) - mean) / static_cast<double>(++n);
+            }
+
+            double result() const
+            {
+                return mean;
+            }
+        };
+
+        // Welford's algorithm, numerically stable single pass variance
+        struct welford_acc
+        {
+            size_t ddof;
+            size_t n = 0;
+            double mean = 0;
+            double m2 = 0;
+
+            template<typename T>
+            void push(T const &v)
+            {
+                double const x = static_cast<double>(v);
+                double const delta = x - mean;
+                mean += delta / static_cast<double>(++n);
+                m2 += delta * (x - mean);
+            }
+
+            double result() const
+            {
+                return n > ddof ? m2 / static_cast<double>(n - ddof) : 0.0;
+            }
+        };
+
+        struct stddev_acc: welford_acc
+        {
+            double result() const
+            {
+                return std::sqrt(welford_acc::result());
+            }
+        };
+
+        template<typename R, typename Fn>
+        struct fold_acc
+        {
+            R value;
+            Fn fn;
+
+            template<typename T>
+            void push(T const &v)
+            {
+                value = fn(value, v);
+            }
+
+            R result() const
+            {
+                return value;
+            }
+        };
+
+        template<template<typename...> class Acc, typename... Args>
+        struct typed
+        {
+            std::tuple<Args...> args;
+
+            template<typename T>
+            Acc<T, Args...> bind() const
+            {
+                return std::apply([](auto const &... a) { return Acc<T, Args...>{ a... }; }, args);
+            }
+        };
+    }
+
+    inline internal::count_acc count()
+    {
+        return {};
+    }
+
+    inline internal::typed<internal::sum_acc> sum()
+    {
+        return {};
+    }
+
+    template<typename Compare = std::less<>>
+    internal::typed<internal::min_acc, Compare> min(Compare cmp = Compare{})
+    {
+        return { std::make_tuple(cmp) };
+    }
+
+    template<typename Compare = std::less<>>
+    auto max(Compare cmp = Compare{})
+    {
+        auto greater = [cmp](auto const &a, auto const &b) { return cmp(b, a); };
+        return internal::typed<internal::min_acc, decltype(greater)>{ std::make_tuple(greater) };
+    }
+
+    inline internal::mean_acc mean()
+    {
+        return {};
+    }
+
+    // Sample variance by default, ddof = 0 gives the population variance
+    inline internal::welford_acc variance(size_t ddof = 1)
+    {
+        return { ddof };
+    }
+
+    inline internal::stddev_acc stddev(size_t ddof = 1)
+    {
+        return { { ddof } };
+    }
+
+    // Custom accumulator built from an initial value and a binary function, as for reduce
+    template<typename R, typename Fn>
+    internal::fold_acc<std::decay_t<R>, std::decay_t<Fn>> fold(R && init, Fn && fn)
+    {
+        return { std::forward<R>(init), std::forward<Fn>(fn) };
+    }
+}
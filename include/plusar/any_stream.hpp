@@ -0,0 +1,210 @@
+#pragma once
+#include <plusar/stream.hpp>
+#include <algorithm>
+#include <optional>
+#include <array>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <cstddef>
+
+namespace plusar
+{
+    namespace internal
+    {
+        template<typename T>
+        struct erased_stream
+        {
+            virtual ~erased_stream() = default;
+            virtual size_t next_batch(T *out, size_t n) const = 0;
+            virtual size_t advance(size_t n) const = 0;
+            virtual std::optional<size_t> size_hint() const = 0;
+            virtual erased_stream * copy_to(void *storage, size_t capacity) const = 0;
+            virtual erased_stream * move_to(void *storage, size_t capacity) = 0;
+        };
+
+        template<typename T, typename S>
+        struct erased_stream_impl final : erased_stream<T>
+        {
+            S s;
+
+            explicit erased_stream_impl(S const &s):
+                s(s)
+            {}
+
+            explicit erased_stream_impl(S &&s):
+                s(std::move(s))
+            {}
+
+            // Placed in the inline storage when it fits and moves without throwing, otherwise on the heap
+            template<typename... Args>
+            static erased_stream<T> * create(void *storage, size_t capacity, Args &&... args)
+            {
+                if constexpr (std::is_nothrow_move_constructible<S>::value && alignof(erased_stream_impl) <= alignof(std::max_align_t))
+                {
+                    if (sizeof(erased_stream_impl) <= capacity)
+                        return new(storage) erased_stream_impl(std::forward<Args>(args)...);
+                }
+                return new erased_stream_impl(std::forward<Args>(args)...);
+            }
+
+            size_t next_batch(T *out, size_t n) const override
+            {
+                return s.next_batch(out, n);
+            }
+
+            size_t advance(size_t n) const override
+            {
+                return s.advance(n);
+            }
+
+            std::optional<size_t> size_hint() const override
+            {
+                return s.size_hint();
+            }
+
+            erased_stream<T> * copy_to(void *storage, size_t capacity) const override
+            {
+                return create(storage, capacity, s);
+            }
+
+            erased_stream<T> * move_to(void *storage, size_t capacity) override
+            {
+                return create(storage, capacity, std::move(s));
+            }
+        };
+
+        // Holds any stream of T. Small streams live in the inline storage, larger ones on the heap.
+        // Elements are pulled from the held stream in batches, one virtual call per batch.
+        template<typename T, size_t Capacity>
+        class any_stream_fn
+        {
+            static constexpr size_t batch = std::max<size_t>(1, 256 / sizeof(T));
+
+            alignas(std::max_align_t) unsigned char _storage[Capacity];
+            erased_stream<T> *_impl = nullptr;
+            mutable std::array<T, batch> _buffer;
+            mutable size_t _pos = 0;
+            mutable size_t _size = 0;
+
+            bool is_inline() const
+            {
+                return static_cast<void const *>(_impl) == _storage;
+            }
+
+            void destroy()
+            {
+                if (is_inline())
+                    _impl->~erased_stream();
+                else
+                    delete _impl;
+                _impl = nullptr;
+            }
+
+            // Inline streams move without throwing, see erased_stream_impl::create
+            void take(any_stream_fn &other) noexcept
+            {
+                if (other.is_inline())
+                    _impl = other._impl->move_to(_storage, Capacity);
+                else
+                    std::swap(_impl, other._impl);
+                other._pos = other._size = 0;
+            }
+
+        public:
+            template<typename Fn,
+                     typename = std::enable_if_t<std::is_same<typename stream<Fn>::type, T>::value
+                                                 && !std::is_same<Fn, any_stream_fn>::value>>
+            explicit any_stream_fn(stream<Fn> const &s):
+                _impl(erased_stream_impl<T, stream<Fn>>::create(_storage, Capacity, s))
+            {}
+
+            // A copy of a moved from stream is empty
+            any_stream_fn(any_stream_fn const &other):
+                _impl(other._impl ? other._impl->copy_to(_storage, Capacity) : nullptr),
+                _buffer(other._buffer),
+                _pos(other._pos),
+                _size(other._size)
+            {}
+
+            any_stream_fn(any_stream_fn &&other) noexcept(std::is_nothrow_move_constructible<T>::value):
+                _buffer(std::move(other._buffer)),
+                _pos(other._pos),
+                _size(other._size)
+            {
+                take(other);
+            }
+
+            any_stream_fn & operator = (any_stream_fn const &) = delete;
+
+            any_stream_fn & operator = (any_stream_fn &&other) noexcept(std::is_nothrow_move_assignable<T>::value)
+            {
+                if (this != &other)
+                {
+                    if (_impl)
+                        destroy();
+                    _buffer = std::move(other._buffer);
+                    _pos = other._pos;
+                    _size = other._size;
+                    take(other);
+                }
+                return *this;
+            }
+
+            ~any_stream_fn()
+            {
+                if (_impl)
+                    destroy();
+            }
+
+            std::optional<T> operator()() const
+            {
+                if (_pos == _size)
+                {
+                    _pos = 0;
+                    _size = _impl ? _impl->next_batch(_buffer.data(), batch) : 0;
+                    if (!_size)
+                        return std::nullopt;
+                }
+                return std::move(_buffer[_pos++]);
+            }
+
+            // Buffered elements go first, the rest is read directly into out
+            size_t next_batch(T *out, size_t n) const
+            {
+                size_t const buffered = std::min(n, _size - _pos);
+                std::move(_buffer.begin() + _pos, _buffer.begin() + _pos + buffered, out);
+                _pos += buffered;
+                return buffered + (n > buffered && _impl ? _impl->next_batch(out + buffered, n - buffered) : 0);
+            }
+
+            size_t advance(size_t n) const
+            {
+                size_t const buffered = std::min(n, _size - _pos);
+                _pos += buffered;
+                return buffered + (n > buffered && _impl ? _impl->advance(n - buffered) : 0);
+            }
+
+            std::optional<size_t> size_hint() const
+            {
+                auto const size = _impl ? _impl->size_hint() : std::make_optional<size_t>(0);
+                return size ? std::make_optional(saturating_add(*size, _size - _pos)) : std::nullopt;
+            }
+        };
+    }
+
+    // Stream of T hiding the type of the pipeline producing it, so pipelines can be kept in containers,
+    // returned from factories or built in other translation units. Pipelines up to Capacity bytes are stored
+    // without heap allocation.
+    // Elements are read ahead from the held pipeline in batches (about 256 bytes), so its side effects may run
+    // before the elements are consumed. T must be default constructible and the same as the element type
+    // of the held pipeline.
+    template<typename T, size_t Capacity = 64>
+    using any_stream = stream<internal::any_stream_fn<T, Capacity>>;
+
+    template<typename T, size_t Capacity = 64, typename Fn>
+    any_stream<T, Capacity> make_any_stream(stream<Fn> const &s)
+    {
+        return any_stream<T, Capacity>(s);
+    }
+}
@@ -0,0 +1,412 @@
+#pragma once
+#include <plusar/stream.hpp>
+#include <plusar/channel.hpp>
+#include <plusar/trace.hpp>
+#include <stdexcept>
+#include <exception>
+#include <algorithm>
+#include <optional>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <future>
+#include <chrono>
+#include <memory>
+#include <deque>
+
+namespace plusar
+{
+    // Thrown by async_map when an operation isn't completed in time
+    class async_timeout : public std::runtime_error
+    {
+    public:
+        async_timeout():
+            std::runtime_error("asynchronous operation timed out")
+        {}
+    };
+
+    namespace internal
+    {
+        // The future of a std::async task waits for the task when it's destroyed. Futures dropped before they're
+        // ready are kept here and destroyed in turn by a single helper thread, so nobody waits for them.
+        // A future which never becomes ready holds up the ones dropped after it, so futures of other kinds are
+        // expected to become ready too.
+        class reaper
+        {
+            struct pending
+            {
+                virtual ~pending() = default;
+                virtual void wait() = 0;
+            };
+
+            template<typename T>
+            struct pending_future : pending
+            {
+                std::future<T> result;
+
+                explicit pending_future(std::future<T> &&result):
+                    result(std::move(result))
+                {}
+
+                void wait() override
+                {
+                    result.wait();
+                }
+            };
+
+            std::mutex                           _mutex;
+            std::condition_variable              _cv;
+            std::deque<std::unique_ptr<pending>> _pending;
+            bool                                 _started = false;
+
+            void run()
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                for(;;)
+                {
+                    _cv.wait(lock, [this] { return !_pending.empty(); });
+                    auto next = std::move(_pending.front());
+                    _pending.pop_front();
+                    lock.unlock();
+                    next->wait();
+                    next.reset();
+                    lock.lock();
+                }
+            }
+
+        public:
+            // Never destroyed, the helper thread may outlive static destructors
+            static reaper & instance()
+            {
+                static reaper *r = new reaper();
+                return *r;
+            }
+
+            template<typename T>
+            void keep(std::future<T> &&result)
+            {
+                if (!result.valid() || result.wait_for(std::chrono::seconds::zero()) != std::future_status::timeout)
+                    return;
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _pending.push_back(std::make_unique<pending_future<T>>(std::move(result)));
+                    if (!_started)
+                    {
+                        std::thread([this] { run(); }).detach();
+                        _started = true;
+                    }
+                }
+                _cv.notify_one();
+            }
+        };
+    }
+
+    // Completion callback passed to callback style async_map functions. May be invoked from any thread.
+    template<typename R>
+    class completion
+    {
+        std::shared_ptr<std::promise<R>>       _promise;
+        std::shared_ptr<internal::ready_signal> _signal;
+
+    public:
+        explicit completion(std::shared_ptr<std::promise<R>> promise, std::shared_ptr<internal::ready_signal> signal = nullptr):
+            _promise(std::move(promise)),
+            _signal(std::move(signal))
+        {}
+
+        void operator()(R value) const
+        {
+            _promise->set_value(std::move(value));
+            if (_signal)
+                _signal->notify();
+        }
+
+        void fail(std::exception_ptr error) const
+        {
+            _promise->set_exception(error);
+            if (_signal)
+                _signal->notify();
+        }
+    };
+
+    namespace internal
+    {
+        template<typename FnR, typename T, typename R>
+        struct async_result
+        {
+            using type = R;
+        };
+
+        template<typename FnR, typename T>
+        struct async_result<FnR, T, void>
+        {
+            using type = decltype(std::declval<std::invoke_result_t<FnR const &, T const &>>().get());
+        };
+
+        template<typename Src, typename FnR, typename R, bool Ordered>
+        struct async_map_fn
+        {
+            using clock = std::chrono::steady_clock;
+            using source_type = typename Src::type;
+            using result_type = typename async_result<FnR, source_type, R>::type;
+
+            template<typename S, typename = void>
+            struct has_watch : std::false_type {};
+
+            template<typename S>
+            struct has_watch<S, std::void_t<decltype(std::declval<S const &>().watch(std::declval<std::shared_ptr<ready_signal> const &>()))>> : std::true_type {};
+
+            // Sources like channels signal arrivals, so next_until starts their elements while it waits
+            static constexpr bool watched = has_watch<Src>::value;
+
+            // Completion callbacks signal every operation. Returned futures are watched by a waiter thread each
+            // when the stage waits for any event, the first operation of the ordered map is waited for directly.
+            static constexpr bool signalled = !std::is_void<R>::value || !Ordered || watched;
+
+            struct operation
+            {
+                std::future<result_type> result;
+                clock::time_point        deadline;
+            };
+
+            Src src;
+            FnR fn;
+            size_t max_in_flight;
+            std::chrono::nanoseconds timeout;
+            mutable std::shared_ptr<std::deque<operation>> ops;
+            mutable std::shared_ptr<ready_signal> signal;
+            mutable bool exhausted = false;
+
+            async_map_fn(Src const &src, FnR fn, size_t max_in_flight, std::chrono::nanoseconds timeout):
+                src(src),
+                fn(std::move(fn)),
+                max_in_flight(std::max<size_t>(max_in_flight, 1)),
+                timeout(timeout)
+            {}
+
+            async_map_fn(async_map_fn const &other):
+                src(other.src),
+                fn(other.fn),
+                max_in_flight(other.max_in_flight),
+                timeout(other.timeout)
+            {}
+
+            // The waiter of a returned future forwards its result, or gives up at the deadline and leaves the future
+            // to the reaper. Waiters end by the deadline, so at most max_in_flight of them run for a stage with a timeout.
+            std::future<result_type> start(source_type const &v, clock::time_point until) const
+            {
+                if constexpr (!signalled)
+                    return fn(v);
+                else
+                {
+                    auto promise = std::make_shared<std::promise<result_type>>();
+                    auto result = promise->get_future();
+
+                    if constexpr (!std::is_void<R>::value)
+                        fn(v, completion<R>(std::move(promise), signal));
+                    else
+                    {
+                        std::thread([source = fn(v), done = completion<result_type>(std::move(promise), signal), until]() mutable
+                        {
+                            if (until == clock::time_point::max())
+                                source.wait();
+                            else if (source.wait_until(until) == std::future_status::timeout)
+                            {
+                                reaper::instance().keep(std::move(source));
+                                done.fail(std::make_exception_ptr(async_timeout()));
+                                return;
+                            }
+
+                            try
+                            {
+                                done(source.get());
+                            }
+                            catch(...)
+                            {
+                                done.fail(std::current_exception());
+                            }
+                        }).detach();
+                    }
+                    return result;
+                }
+            }
+
+            // Futures returned by fn are waited for when they're destroyed if they come from std::async
+            static void release(std::future<result_type> &&result)
+            {
+                if constexpr (!signalled)
+                    reaper::instance().keep(std::move(result));
+            }
+
+            void init() const
+            {
+                if (!ops)
+                {
+                    ops = std::shared_ptr<std::deque<operation>>(new std::deque<operation>(), [](std::deque<operation> *pending)
+                    {
+                        for(auto &op : *pending)
+                            release(std::move(op.result));
+                        delete pending;
+                    });
+                    signal = std::make_shared<ready_signal>();
+                    if constexpr (watched)
+                        src.watch(signal);
+                }
+            }
+
+            clock::time_point deadline() const
+            {
+                if (!timeout.count())
+                    return clock::time_point::max();
+                auto const now = clock::now();
+                return timeout < clock::time_point::max() - now ? now + timeout : clock::time_point::max();
+            }
+
+            void push(source_type const &v) const
+            {
+                auto const until = deadline();
+                ops->push_back(operation{ start(v, until), until });
+            }
+
+            void abandon(typename std::deque<operation>::iterator op) const
+            {
+                auto result = std::move(op->result);
+                ops->erase(op);
+                release(std::move(result));
+            }
+
+            result_type take(typename std::deque<operation>::iterator op) const
+            {
+                auto result = std::move(op->result);
+                ops->erase(op);
+                return result.get();
+            }
+
+            // The operation to emit: the first one, or any completed one when unordered. ops->end() when it isn't
+            // completed yet, earliest is then lowered to the next deadline. Throws once an operation passes its deadline.
+            auto completed(clock::time_point &earliest) const
+            {
+                auto const now = clock::now();
+                for(auto op = ops->begin(); op != ops->end(); ++op)
+                {
+                    if (op->result.wait_for(std::chrono::seconds::zero()) == std::future_status::ready)
+                        return op;
+                    if (op->deadline <= now)
+                    {
+                        abandon(op);
+                        throw async_timeout();
+                    }
+                    earliest = std::min(earliest, op->deadline);
+                    if constexpr (Ordered)
+                        break;
+                }
+                return ops->end();
+            }
+
+            // Result of the operation to emit, nullopt if it isn't completed by 'until'
+            std::optional<result_type> wait(clock::time_point until) const
+            {
+                trace::span span("async_map wait", "queue");
+
+                if constexpr (!signalled)
+                {
+                    auto op = ops->begin();
+                    if (op->result.wait_until(std::min(op->deadline, until)) == std::future_status::timeout)
+                    {
+                        if (op->deadline > until)
+                            return std::nullopt;
+                        abandon(op);
+                        throw async_timeout();
+                    }
+                    return take(op);
+                }
+                else
+                {
+                    for(;;)
+                    {
+                        auto const seen = signal->count();
+                        auto earliest = until;
+                        auto op = completed(earliest);
+                        if (op != ops->end())
+                            return take(op);
+                        if (until <= clock::now())
+                            return std::nullopt;
+                        signal->wait(seen, earliest);
+                    }
+                }
+            }
+
+            std::optional<result_type> operator()() const
+            {
+                init();
+
+                while(!exhausted && ops->size() < max_in_flight)
+                {
+                    auto v = src.next();
+                    if (!v)
+                        exhausted = true;
+                    else
+                        push(*v);
+                }
+
+                if (ops->empty())
+                    return std::nullopt;
+                return wait(clock::time_point::max());
+            }
+
+            // The source is polled while operations are in flight and waited for until the deadline when none are.
+            // Arrivals at a watched source wake the wait for operations, other sources are polled again only once
+            // an operation completes.
+            template<typename S = Src>
+            auto next_until(std::optional<result_type> &out, clock::time_point until) const
+                -> decltype(std::declval<S const &>().next_until(std::declval<std::optional<source_type> &>(), until))
+            {
+                init();
+
+                for(;;)
+                {
+                    auto const seen = signal->count();      // events after the poll end the wait below
+
+                    while(!exhausted && ops->size() < max_in_flight)
+                    {
+                        std::optional<source_type> v;
+                        auto const status = src.next_until(v, ops->empty() ? until : clock::time_point{});
+                        if (status == pull_status::timeout)
+                            break;
+                        if (status == pull_status::end)
+                            exhausted = true;
+                        else
+                            push(*v);
+                    }
+
+                    if (ops->empty())
+                        return exhausted ? pull_status::end : pull_status::timeout;
+
+                    if constexpr (watched)
+                    {
+                        auto earliest = until;
+                        auto op = completed(earliest);
+                        if (op != ops->end())
+                        {
+                            out.emplace(take(op));
+                            return pull_status::ready;
+                        }
+                        if (until <= clock::now())
+                            return pull_status::timeout;
+
+                        trace::span span("async_map wait", "queue");
+                        signal->wait(seen, earliest);
+                    }
+                    else
+                    {
+                        auto r = wait(until);
+                        if (!r)
+                            return pull_status::timeout;
+                        out.emplace(std::move(*r));
+                        return pull_status::ready;
+                    }
+                }
+            }
+        };
+    }
+}
@@ -0,0 +1,282 @@
+#pragma once
+#include <plusar/stream.hpp>
+#include <plusar/file.hpp>
+#include <type_traits>
+#include <algorithm>
+#include <optional>
+#include <utility>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+#include <mutex>
+#include <new>
+#include <cstddef>
+
+namespace plusar
+{
+    namespace internal
+    {
+        // Elements of the source materialized in chunks of contiguous memory as they are first requested.
+        // Elements never move once stored. Chunks beyond the memory limit are placed in a mapped temporary
+        // file when the elements are trivially copyable and mmap is available.
+        template<typename Src>
+        class cache_state
+        {
+        public:
+            using type = typename Src::type;
+
+        private:
+            static constexpr size_t chunk_shift = 12;
+            static constexpr size_t chunk_size = size_t{ 1 } << chunk_shift;
+            static constexpr size_t chunk_bytes = chunk_size * sizeof(type);
+
+            struct chunk
+            {
+                type *data;
+                bool mapped;
+            };
+
+            Src                        _src;
+            size_t                     _memory_limit;
+            std::pmr::memory_resource *_resource;
+            std::mutex                 _mutex;
+            std::vector<chunk>         _chunks;
+            size_t                     _size = 0;
+            size_t                     _memory = 0;
+            bool                       _done = false;
+#ifdef PLUSAR_HAS_MMAP
+            std::unique_ptr<spill_file> _file;
+#endif
+
+            cache_state(cache_state const &) = delete;
+            cache_state & operator = (cache_state const &) = delete;
+
+            bool can_spill() const
+            {
+#ifdef PLUSAR_HAS_MMAP
+                return std::is_trivially_copyable<type>::value && chunk_bytes % static_cast<size_t>(::sysconf(_SC_PAGESIZE)) == 0;
+#else
+                return false;
+#endif
+            }
+
+            void add_chunk()
+            {
+#ifdef PLUSAR_HAS_MMAP
+                if (_memory + chunk_bytes > _memory_limit && can_spill())
+                {
+                    if (!_file)
+                        _file = std::make_unique<spill_file>("cache");
+                    _chunks.push_back(chunk{ static_cast<type *>(_file->grow(chunk_bytes)), true });
+                    return;
+                }
+#endif
+                _chunks.push_back(chunk{ static_cast<type *>(_resource->allocate(chunk_bytes, alignof(type))), false });
+                _memory += chunk_bytes;
+            }
+
+            // Pulls the source until count elements are stored. Called with the mutex held.
+            void fill(size_t count)
+            {
+                while(_size < count && !_done)
+                {
+                    auto v = _src.next();
+                    if (!v)
+                    {
+                        _done = true;
+                        break;
+                    }
+                    if ((_size >> chunk_shift) == _chunks.size())
+                        add_chunk();
+                    new(_chunks.back().data + (_size & (chunk_size - 1))) type(std::move(*v));
+                    ++_size;
+                }
+            }
+
+        public:
+            cache_state(Src const &src, size_t memory_limit, std::pmr::memory_resource *resource):
+                _src(src),
+                _memory_limit(memory_limit),
+                _resource(resource)
+            {}
+
+            ~cache_state()
+            {
+                for(size_t i = 0; i < _chunks.size(); ++i)
+                {
+                    auto &c = _chunks[i];
+                    size_t const n = std::min(chunk_size, _size - i * chunk_size);
+                    for(size_t j = 0; j < n; ++j)
+                        c.data[j].~type();
+#ifdef PLUSAR_HAS_MMAP
+                    if (c.mapped)
+                    {
+                        ::munmap(c.data, chunk_bytes);
+                        continue;
+                    }
+#endif
+                    _resource->deallocate(c.data, chunk_bytes, alignof(type));
+                }
+            }
+
+            // Number of stored elements after storing up to count of them
+            size_t size(size_t count)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                fill(count);
+                return std::min(_size, count);
+            }
+
+            // Number of elements up to end, stored or not, without pulling the source.
+            // nullopt when some of them aren't stored and the source doesn't know its size.
+            std::optional<size_t> size_hint(size_t end)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (_done || _size >= end)
+                    return std::min(_size, end);
+                auto const rest = _src.size_hint();
+                if (!rest)
+                    return std::nullopt;
+                return std::min(saturating_add(_size, *rest), end);
+            }
+
+            // Element i and the number of elements stored contiguously from it, nullptr past the end
+            std::pair<type const *, size_t> view(size_t i)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                fill(i + 1);
+                if (i >= _size)
+                    return { nullptr, 0 };
+                size_t const begin = i & (chunk_size - 1);
+                return { _chunks[i >> chunk_shift].data + begin, std::min(chunk_size - begin, _size - i) };
+            }
+
+            size_t bytes_in_memory()
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                return _memory;
+            }
+        };
+
+        // Stream over the cached elements [pos, end). Reads stored chunks directly and locks only to move to the next one.
+        template<typename Src>
+        struct replay_fn
+        {
+            using type = typename Src::type;
+
+            std::shared_ptr<cache_state<Src>> state;
+            mutable size_t pos;
+            size_t end;                             // SIZE_MAX: up to the end of the source
+            mutable type const *data = nullptr;     // elements [data_begin, data_end)
+            mutable size_t data_begin = 0;
+            mutable size_t data_end = 0;
+
+            bool load() const
+            {
+                if (pos >= end)
+                    return false;
+                auto const v = state->view(pos);
+                if (!v.first)
+                    return false;
+                data = v.first;
+                data_begin = pos;
+                data_end = std::min(end, pos + v.second);
+                return true;
+            }
+
+            std::optional<type> operator()() const
+            {
+                if ((pos < data_begin || pos >= data_end) && !load())
+                    return std::nullopt;
+                return data[pos++ - data_begin];
+            }
+
+            size_t advance(size_t count) const
+            {
+                size_t const target = saturating_add(pos, std::min(count, end - pos));
+                size_t const reached = std::max(pos, state->size(target));
+                count = reached - pos;
+                pos = reached;
+                return count;
+            }
+
+            std::optional<size_t> size_hint() const
+            {
+                auto const last = state->size_hint(end);
+                if (!last || *last == SIZE_MAX)
+                    return last;
+                return *last > pos ? *last - pos : 0;
+            }
+
+            std::optional<type> at(size_t i) const
+            {
+                size_t const index = saturating_add(pos, i);
+                if (index >= end)
+                    return std::nullopt;
+                auto const v = state->view(index);
+                return v.first ? std::make_optional(*v.first) : std::nullopt;
+            }
+
+            size_t next_batch(type *out, size_t count) const
+            {
+                size_t n = 0;
+                while(n < count)
+                {
+                    if ((pos < data_begin || pos >= data_end) && !load())
+                        break;
+                    size_t const k = std::min(count - n, data_end - pos);
+                    std::copy(data + (pos - data_begin), data + (pos - data_begin) + k, out + n);
+                    pos += k;
+                    n += k;
+                }
+                return n;
+            }
+
+            // Splits the remaining elements when their number is known. Elements of both parts are stored on demand.
+            std::optional<replay_fn> try_split() const
+            {
+                auto const size = size_hint();
+                if (!size || *size == SIZE_MAX || *size < 2)
+                    return std::nullopt;
+                size_t const half = pos + *size / 2;
+                replay_fn prefix{ state, pos, half };
+                pos = half;
+                return prefix;
+            }
+        };
+    }
+
+    // Elements of a stream stored as they are first produced, replayed by any number of streams.
+    // Replay streams provide random access, they may be pulled from different threads. Their size is known
+    // once the source is exhausted, or as long as the source knows its own size.
+    template<typename Src>
+    class cached
+    {
+        std::shared_ptr<internal::cache_state<Src>> _state;
+
+    public:
+        using type = typename Src::type;
+
+        cached(Src const &src, size_t memory_limit, std::pmr::memory_resource *resource = std::pmr::get_default_resource()):
+            _state(std::make_shared<internal::cache_state<Src>>(src, memory_limit, resource))
+        {}
+
+        // Stream of the elements from the first one. Elements not stored yet are pulled from the source on demand.
+        auto replay() const
+        {
+            return internal::make_stage("cache", internal::replay_fn<Src>{ _state, 0, SIZE_MAX });
+        }
+
+        // Number of elements. Stores the whole source.
+        size_t size() const
+        {
+            return _state->size(SIZE_MAX);
+        }
+
+        // Memory used by chunks held in memory, chunks spilled to the temporary file aren't counted
+        size_t bytes_in_memory() const
+        {
+            return _state->bytes_in_memory();
+        }
+    };
+}
@@ -0,0 +1,198 @@
+#pragma once
+#include <plusar/stream.hpp>
+#include <condition_variable>
+#include <algorithm>
+#include <optional>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <mutex>
+
+namespace plusar
+{
+    namespace internal
+    {
+        // Counts events, like completed operations or elements pushed to a channel, so a consumer waits for any of them
+        struct ready_signal
+        {
+            std::mutex              mutex;
+            std::condition_variable cv;
+            size_t                  events = 0;
+
+            void notify()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    ++events;
+                }
+                cv.notify_all();
+            }
+
+            size_t count()
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                return events;
+            }
+
+            // Waits until the count differs from seen or until the deadline
+            void wait(size_t seen, std::chrono::steady_clock::time_point until)
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                auto const signalled = [this, seen] { return events != seen; };
+                if (until == std::chrono::steady_clock::time_point::max())
+                    cv.wait(lock, signalled);
+                else
+                    cv.wait_until(lock, until, signalled);
+            }
+        };
+
+        template<typename T>
+        struct channel_state
+        {
+            std::mutex                               mutex;
+            std::condition_variable                  not_empty;
+            std::condition_variable                  not_full;
+            std::deque<T>                            items;
+            size_t                                   capacity;
+            bool                                     closed = false;
+            std::vector<std::weak_ptr<ready_signal>> watchers;     // stages waiting for the channel among other events
+
+            explicit channel_state(size_t capacity):
+                capacity(std::max<size_t>(capacity, 1))
+            {}
+
+            // Called with the mutex held after an element is pushed or the channel is closed
+            void wake()
+            {
+                watchers.erase(std::remove_if(watchers.begin(), watchers.end(), [](auto const &w)
+                {
+                    auto signal = w.lock();
+                    if (signal)
+                        signal->notify();
+                    return !signal;
+                }), watchers.end());
+            }
+        };
+
+        // Receiving end of a channel. Receivers of the same channel take elements in turn.
+        template<typename T>
+        struct receiver_fn
+        {
+            using clock = std::chrono::steady_clock;
+
+            std::shared_ptr<channel_state<T>> state;
+
+            std::optional<T> operator()() const
+            {
+                std::optional<T> v;
+                next_until(v, clock::time_point::max());
+                return v;
+            }
+
+            pull_status next_until(std::optional<T> &out, clock::time_point deadline) const
+            {
+                auto &s = *state;
+                std::unique_lock<std::mutex> lock(s.mutex);
+                auto const ready = [&s]() { return !s.items.empty() || s.closed; };
+                if (deadline == clock::time_point::max())
+                    s.not_empty.wait(lock, ready);
+                else if (!s.not_empty.wait_until(lock, deadline, ready))
+                    return pull_status::timeout;
+
+                if (s.items.empty())
+                    return pull_status::end;
+                out.emplace(std::move(s.items.front()));
+                s.items.pop_front();
+                lock.unlock();
+                s.not_full.notify_one();
+                return pull_status::ready;
+            }
+
+            // Notifies the signal of every element pushed and of the channel being closed, so a stage waiting
+            // for other events wakes for the channel too
+            void watch(std::shared_ptr<ready_signal> const &signal) const
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->watchers.push_back(signal);
+            }
+
+            // Waits for the first element, then takes the ones already queued
+            size_t next_batch(T *out, size_t n) const
+            {
+                auto &s = *state;
+                std::unique_lock<std::mutex> lock(s.mutex);
+                s.not_empty.wait(lock, [&s]() { return !s.items.empty() || s.closed; });
+
+                size_t const count = std::min(n, s.items.size());
+                std::move(s.items.begin(), s.items.begin() + count, out);
+                s.items.erase(s.items.begin(), s.items.begin() + count);
+                lock.unlock();
+                s.not_full.notify_all();
+                return count;
+            }
+        };
+    }
+
+    // Bounded queue connecting producer threads to streams. Copies refer to the same channel.
+    // Streams returned by receive() end once the channel is closed and drained.
+    template<typename T>
+    class channel
+    {
+        std::shared_ptr<internal::channel_state<T>> _state;
+
+    public:
+        explicit channel(size_t capacity = SIZE_MAX):
+            _state(std::make_shared<internal::channel_state<T>>(capacity))
+        {}
+
+        // Waits while the channel is full. Returns false if the channel is closed.
+        bool push(T value) const
+        {
+            auto &s = *_state;
+            std::unique_lock<std::mutex> lock(s.mutex);
+            s.not_full.wait(lock, [&s]() { return s.items.size() < s.capacity || s.closed; });
+            if (s.closed)
+                return false;
+            s.items.push_back(std::move(value));
+            s.wake();
+            lock.unlock();
+            s.not_empty.notify_one();
+            return true;
+        }
+
+        // Returns false if the channel is full or closed
+        bool try_push(T value) const
+        {
+            auto &s = *_state;
+            {
+                std::lock_guard<std::mutex> lock(s.mutex);
+                if (s.closed || s.items.size() >= s.capacity)
+                    return false;
+                s.items.push_back(std::move(value));
+                s.wake();
+            }
+            s.not_empty.notify_one();
+            return true;
+        }
+
+        // Rejects further elements. Queued elements are still received.
+        void close() const
+        {
+            {
+                std::lock_guard<std::mutex> lock(_state->mutex);
+                _state->closed = true;
+                _state->wake();
+            }
+            _state->not_empty.notify_all();
+            _state->not_full.notify_all();
+        }
+
+        // Stream of the received elements. Pulls block until an element arrives or the channel is closed,
+        // next_until waits until a deadline.
+        auto receive() const
+        {
+            return internal::make_stage("channel", internal::receiver_fn<T>{ _state });
+        }
+    };
+}
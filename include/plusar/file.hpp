@@ -0,0 +1,319 @@
+#pragma once
+#include <plusar/stream.hpp>
+#include <type_traits>
+#include <system_error>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <memory>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <cstddef>
+
+#if defined(__unix__) || defined(__APPLE__)
+#   define PLUSAR_HAS_MMAP
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
+
+namespace plusar
+{
+    namespace internal
+    {
+        // Read only file mapping. Falls back to reading the file into memory where mmap isn't available.
+        class mapped_file
+        {
+            char const *_data = nullptr;
+            size_t _size = 0;
+#ifndef PLUSAR_HAS_MMAP
+            std::vector<char> _buffer;
+#endif
+
+            mapped_file(mapped_file const &) = delete;
+            mapped_file & operator = (mapped_file const &) = delete;
+
+        public:
+            explicit mapped_file(std::string const &path)
+            {
+#ifdef PLUSAR_HAS_MMAP
+                int fd = ::open(path.c_str(), O_RDONLY);
+                if (fd < 0)
+                    throw std::system_error(errno, std::generic_category(), "open " + path);
+
+                struct stat st;
+                if (::fstat(fd, &st) < 0)
+                {
+                    int err = errno;
+                    ::close(fd);
+                    throw std::system_error(err, std::generic_category(), "stat " + path);
+                }
+
+                _size = static_cast<size_t>(st.st_size);
+                if (_size)
+                {
+                    void *addr = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+                    if (addr == MAP_FAILED)
+                    {
+                        int err = errno;
+                        ::close(fd);
+                        throw std::system_error(err, std::generic_category(), "mmap " + path);
+                    }
+                    ::madvise(addr, _size, MADV_SEQUENTIAL);
+                    _data = static_cast<char const *>(addr);
+                }
+                ::close(fd);
+#else
+                std::ifstream file(path, std::ios::binary);
+                if (!file)
+                    throw std::system_error(std::make_error_code(std::errc::no_such_file_or_directory), "open " + path);
+                _buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+                _data = _buffer.data();
+                _size = _buffer.size();
+#endif
+            }
+
+            ~mapped_file()
+            {
+#ifdef PLUSAR_HAS_MMAP
+                if (_data)
+                    ::munmap(const_cast<char *>(_data), _size);
+#endif
+            }
+
+            char const * data() const
+            {
+                return _data;
+            }
+
+            size_t size() const
+            {
+                return _size;
+            }
+        };
+
+        // Fixed size records of a mapped file
+        template<typename T>
+        struct record_file_fn
+        {
+            std::shared_ptr<mapped_file const> file;
+            size_t end;
+            mutable_idx n;
+
+            size_t remaining() const
+            {
+                return end - n.value;
+            }
+
+            std::optional<T> at(size_t i) const
+            {
+                if (i >= remaining())
+                    return std::nullopt;
+                T v;
+                std::memcpy(&v, file->data() + (n.value + i) * sizeof(T), sizeof(T));
+                return v;
+            }
+
+            std::optional<T> operator()() const
+            {
+                auto v = at(0);
+                if (v)
+                    ++n.value;
+                return v;
+            }
+
+            size_t advance(size_t count) const
+            {
+                count = std::min(count, remaining());
+                n.value += count;
+                return count;
+            }
+
+            std::optional<size_t> size_hint() const
+            {
+                return remaining();
+            }
+
+            size_t next_batch(T *out, size_t count) const
+            {
+                count = std::min(count, remaining());
+                std::memcpy(out, file->data() + n.value * sizeof(T), count * sizeof(T));
+                n.value += count;
+                return count;
+            }
+
+            std::optional<record_file_fn> try_split() const
+            {
+                if (remaining() < 2)
+                    return std::nullopt;
+                size_t const half = n.value + remaining() / 2;
+                record_file_fn prefix{ file, half, n };
+                n.value = half;
+                return prefix;
+            }
+        };
+
+        // Text lines of a mapped file. Splits happen at line boundaries.
+        struct line_file_fn
+        {
+            std::shared_ptr<mapped_file const> file;
+            size_t end;
+            double bytes_per_line;
+            mutable_idx pos;
+
+            std::optional<std::string> operator()() const
+            {
+                if (pos.value >= end)
+                    return std::nullopt;
+
+                char const *begin = file->data() + pos.value;
+                char const *nl = static_cast<char const *>(std::memchr(begin, '\n', end - pos.value));
+                size_t len = nl ? static_cast<size_t>(nl - begin) : end - pos.value;
+                pos.value += nl ? len + 1 : len;
+
+                if (len && begin[len - 1] == '\r')
+                    --len;
+                return std::string(begin, len);
+            }
+
+            size_t estimated_size() const
+            {
+                return static_cast<size_t>((end - pos.value) / bytes_per_line);
+            }
+
+            std::optional<line_file_fn> try_split() const
+            {
+                size_t const mid = pos.value + (end - pos.value) / 2;
+                if (mid >= end)
+                    return std::nullopt;
+
+                char const *data = file->data();
+                char const *nl = static_cast<char const *>(std::memchr(data + mid, '\n', end - mid));
+                if (!nl || static_cast<size_t>(nl - data) + 1 >= end)
+                    return std::nullopt;
+
+                size_t const cut = nl - data + 1;
+                line_file_fn prefix{ file, cut, bytes_per_line, pos };
+                pos.value = cut;
+                return prefix;
+            }
+        };
+
+#ifdef PLUSAR_HAS_MMAP
+        // Anonymous temporary file in $TMPDIR (or /tmp), written by appending or by mapping new regions
+        class spill_file
+        {
+            int _fd = -1;
+            size_t _size = 0;
+
+            spill_file(spill_file const &) = delete;
+            spill_file & operator = (spill_file const &) = delete;
+
+        public:
+            explicit spill_file(char const *name)
+            {
+                char const *dir = std::getenv("TMPDIR");
+                std::string path = std::string(dir && *dir ? dir : "/tmp") + "/plusar-" + name + "-XXXXXX";
+                _fd = ::mkstemp(&path[0]);
+                if (_fd < 0)
+                    throw std::system_error(errno, std::generic_category(), "mkstemp " + path);
+                ::unlink(path.c_str());
+            }
+
+            ~spill_file()
+            {
+                ::close(_fd);
+            }
+
+            size_t size() const
+            {
+                return _size;
+            }
+
+            // Extends the file by size bytes and maps them for reading and writing
+            void * grow(size_t size)
+            {
+                if (::ftruncate(_fd, static_cast<off_t>(_size + size)) < 0)
+                    throw std::system_error(errno, std::generic_category(), "ftruncate");
+                void *addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, static_cast<off_t>(_size));
+                if (addr == MAP_FAILED)
+                    throw std::system_error(errno, std::generic_category(), "mmap");
+                _size += size;
+                return addr;
+            }
+
+            // Writes size bytes at the end of the file. Returns their offset.
+            size_t append(void const *data, size_t size)
+            {
+                size_t const offset = _size;
+                auto const *p = static_cast<char const *>(data);
+                while(size)
+                {
+                    ssize_t const n = ::pwrite(_fd, p, size, static_cast<off_t>(_size));
+                    if (n < 0)
+                    {
+                        if (errno == EINTR)
+                            continue;
+                        throw std::system_error(errno, std::generic_category(), "pwrite");
+                    }
+                    p += n;
+                    size -= static_cast<size_t>(n);
+                    _size += static_cast<size_t>(n);
+                }
+                return offset;
+            }
+
+            // Reads size bytes at offset. May be called from several threads at once.
+            void read(size_t offset, void *data, size_t size) const
+            {
+                auto *p = static_cast<char *>(data);
+                while(size)
+                {
+                    ssize_t const n = ::pread(_fd, p, size, static_cast<off_t>(offset));
+                    if (n <= 0)
+                    {
+                        if (n < 0 && errno == EINTR)
+                            continue;
+                        throw std::system_error(n < 0 ? errno : EIO, std::generic_category(), "pread");
+                    }
+                    p += n;
+                    offset += static_cast<size_t>(n);
+                    size -= static_cast<size_t>(n);
+                }
+            }
+        };
+#endif
+
+        inline double sample_bytes_per_line(mapped_file const &file)
+        {
+            size_t const sample = std::min<size_t>(file.size(), 4096);
+            size_t const lines = std::count(file.data(), file.data() + sample, '\n');
+            return lines ? static_cast<double>(sample) / lines : std::max<double>(sample, 1);
+        }
+    }
+
+    // Stream of trivially copyable records stored in a binary file
+    template<typename T>
+    auto make_record_stream(std::string const &path)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "records must be trivially copyable");
+
+        auto file = std::make_shared<internal::mapped_file const>(path);
+        size_t const size = file->size() / sizeof(T);
+        return internal::make_stage("record_file", internal::record_file_fn<T>{ std::move(file), size, internal::mutable_idx{} });
+    }
+
+    // Stream of text file lines without line terminators
+    inline auto make_line_stream(std::string const &path)
+    {
+        auto file = std::make_shared<internal::mapped_file const>(path);
+        size_t const size = file->size();
+        double const bytes_per_line = internal::sample_bytes_per_line(*file);
+        return internal::make_stage("line_file", internal::line_file_fn{ std::move(file), size, bytes_per_line, internal::mutable_idx{} });
+    }
+}
@@ -0,0 +1,401 @@
+#pragma once
+#include <plusar/stream.hpp>
+#include <algorithm>
+#include <optional>
+#include <string>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+// Seedable synthetic workloads: uniform and Zipfian keys, payloads and arrival timestamps
+namespace plusar::gen
+{
+    // One step of splitmix64, used to expand seeds
+    constexpr uint64_t splitmix64(uint64_t &state)
+    {
+        uint64_t z = (state += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        return z ^ (z >> 31);
+    }
+
+    // xoshiro256** generator, satisfies UniformRandomBitGenerator
+    class rng
+    {
+        uint64_t _s[4];
+
+        static constexpr uint64_t rotl(uint64_t x, int k)
+        {
+            return (x << k) | (x >> (64 - k));
+        }
+
+    public:
+        using result_type = uint64_t;
+
+        constexpr explicit rng(uint64_t seed = 0):
+            _s{}
+        {
+            for(auto &s : _s)
+                s = splitmix64(seed);
+        }
+
+        static constexpr result_type min() { return 0; }
+        static constexpr result_type max() { return std::numeric_limits<uint64_t>::max(); }
+
+        constexpr result_type operator()()
+        {
+            uint64_t const result = rotl(_s[1] * 5, 7) * 9;
+            uint64_t const t = _s[1] << 17;
+            _s[2] ^= _s[0];
+            _s[3] ^= _s[1];
+            _s[1] ^= _s[2];
+            _s[0] ^= _s[3];
+            _s[2] ^= t;
+            _s[3] = rotl(_s[3], 45);
+            return result;
+        }
+
+        // Advances the generator by 2^128 steps
+        constexpr void jump()
+        {
+            constexpr uint64_t poly[] = { 0x180ec6d33cfd0aba, 0xd5a61266f0c9392c, 0xa9582618e03fc9aa, 0x39abdc4529b1661c };
+
+            uint64_t s[4] = {};
+            for(auto p : poly)
+            {
+                for(int b = 0; b < 64; ++b)
+                {
+                    if (p & (uint64_t{ 1 } << b))
+                    {
+                        for(int i = 0; i < 4; ++i)
+                            s[i] ^= _s[i];
+                    }
+                    (*this)();
+                }
+            }
+
+            for(int i = 0; i < 4; ++i)
+                _s[i] = s[i];
+        }
+
+        // Returns a generator continuing this sequence and moves this one 2^128 steps ahead,
+        // so both produce non-overlapping sequences
+        constexpr rng split()
+        {
+            rng other = *this;
+            jump();
+            return other;
+        }
+
+        // High half of the 128 bit product of a and b
+        static constexpr uint64_t mul_high(uint64_t a, uint64_t b)
+        {
+            uint64_t const al = a & 0xffffffff, ah = a >> 32;
+            uint64_t const bl = b & 0xffffffff, bh = b >> 32;
+            uint64_t const mid = ah * bl + ((al * bl) >> 32);
+            uint64_t const mid2 = al * bh + (mid & 0xffffffff);
+            return ah * bh + (mid >> 32) + (mid2 >> 32);
+        }
+
+        // Uniform value in [0, n) by Lemire's multiply-shift: the high half of x * n. Draws whose low half is
+        // below 2^64 mod n are rejected, as they would favour some values. The division runs only when the low
+        // half is below n, which is rare for small n.
+        constexpr uint64_t below(uint64_t n)
+        {
+            uint64_t x = (*this)();
+            if (x * n < n)
+            {
+                uint64_t const threshold = (0 - n) % n;
+                while(x * n < threshold)
+                    x = (*this)();
+            }
+            return mul_high(x, n);
+        }
+
+        // Uniform value in [0, 1)
+        constexpr double uniform()
+        {
+            return ((*this)() >> 11) * 0x1.0p-53;
+        }
+
+        // Exponentially distributed value of the given mean
+        double exponential(double mean)
+        {
+            return -std::log1p(-uniform()) * mean;
+        }
+    };
+
+    // Uniform keys in [0, keys)
+    struct uniform_keys
+    {
+        uint64_t keys;
+
+        uint64_t operator()(rng &r) const
+        {
+            return r.below(keys);
+        }
+    };
+
+    // Zipfian keys in [0, keys): key k is drawn with probability proportional to 1 / (k + 1)^exponent.
+    // Rejection-inversion sampling (Hormann, Derflinger) takes constant time and memory for any key count.
+    class zipf_keys
+    {
+        uint64_t _keys;
+        double   _exponent;
+        double   _h_integral_x1;
+        double   _h_integral_n;
+        double   _s;
+
+        static double helper1(double x)
+        {
+            return std::abs(x) > 1e-8 ? std::log1p(x) / x : 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x));
+        }
+
+        static double helper2(double x)
+        {
+            return std::abs(x) > 1e-8 ? std::expm1(x) / x : 1 + x * 0.5 * (1 + x / 3 * (1 + 0.25 * x));
+        }
+
+        double h(double x) const
+        {
+            return std::exp(-_exponent * std::log(x));
+        }
+
+        double h_integral(double x) const
+        {
+            double const log_x = std::log(x);
+            return helper2((1 - _exponent) * log_x) * log_x;
+        }
+
+        double h_integral_inverse(double x) const
+        {
+            double t = x * (1 - _exponent);
+            if (t < -1)
+                t = -1;
+            return std::exp(helper1(t) * x);
+        }
+
+    public:
+        zipf_keys(uint64_t keys, double exponent):
+            _keys(std::max<uint64_t>(keys, 1)),
+            _exponent(exponent),
+            _h_integral_x1(h_integral(1.5) - 1),
+            _h_integral_n(h_integral(static_cast<double>(_keys) + 0.5)),
+            _s(2 - h_integral_inverse(h_integral(2.5) - h(2)))
+        {}
+
+        uint64_t operator()(rng &r) const
+        {
+            for(;;)
+            {
+                double const u = _h_integral_n + r.uniform() * (_h_integral_x1 - _h_integral_n);
+                double const x = h_integral_inverse(u);
+                double const k = std::clamp(std::floor(x + 0.5), 1.0, static_cast<double>(_keys));
+                if (k - x <= _s || u >= h_integral(k + 0.5) - h(k))
+                    return static_cast<uint64_t>(k) - 1;
+            }
+        }
+    };
+
+    // Printable payloads of uniformly distributed length in [min_size, max_size]
+    struct payloads
+    {
+        size_t min_size;
+        size_t max_size;
+
+        std::string operator()(rng &r) const
+        {
+            size_t const span = max_size - min_size;      // span + 1 wraps when every length is allowed
+            std::string s(min_size + (span == SIZE_MAX ? r() : r.below(span + 1)), '\0');
+            for(size_t i = 0; i < s.size(); i += 8)
+            {
+                uint64_t bits = r();
+                for(size_t j = i; j < std::min(i + 8, s.size()); ++j, bits >>= 8)
+                    s[j] = static_cast<char>('a' + (bits & 0xff) % 26);
+            }
+            return s;
+        }
+    };
+
+    // Arrivals of a Poisson process of 'rate' events per second
+    struct poisson_process
+    {
+        double mean_gap;        // ns
+
+        explicit poisson_process(double rate):
+            mean_gap(1e9 / rate)
+        {}
+
+        double gap(rng &r)
+        {
+            return r.exponential(mean_gap);
+        }
+    };
+
+    // On/off arrivals: bursts of geometrically distributed length (mean 'burst_size' events) arrive at 'burst_rate',
+    // separated by exponential idle gaps chosen so the long run rate is 'rate' events per second
+    struct bursty_process
+    {
+        double mean_gap;        // ns, within a burst
+        double mean_idle;       // ns, between bursts
+        double continue_burst;  // probability the next event belongs to the current burst
+        bool   in_burst = false;
+
+        bursty_process(double rate, double burst_rate, double burst_size):
+            mean_gap(1e9 / std::max(rate, burst_rate)),
+            mean_idle(std::max(1.0, burst_size) * 1e9 / rate - (std::max(1.0, burst_size) - 1) * mean_gap),
+            continue_burst(1 - 1 / std::max(1.0, burst_size))
+        {}
+
+        double gap(rng &r)
+        {
+            bool const next_in_burst = in_burst && r.uniform() < continue_burst;
+            in_burst = true;
+            return next_in_burst ? r.exponential(mean_gap) : r.exponential(mean_idle);
+        }
+    };
+}
+
+namespace plusar::internal
+{
+    // Draws 'size' values of Dist (SIZE_MAX for endless stream).
+    // Every block of values comes from its own generator seeded by (seed, block index), so the stream
+    // is split at block boundaries and produces the same values no matter how it was split or advanced.
+    template<typename Dist>
+    struct generator_fn
+    {
+        using value_type = decltype(std::declval<Dist const &>()(std::declval<gen::rng &>()));
+
+        static constexpr size_t block = 4096;
+
+        Dist dist;
+        uint64_t seed;
+        size_t size;
+        mutable_idx n;
+        mutable gen::rng rng;
+        mutable bool synced;        // rng is positioned at n
+
+        constexpr size_t remaining() const
+        {
+            return size == SIZE_MAX ? SIZE_MAX : size - n.value;
+        }
+
+        void sync() const
+        {
+            uint64_t state = seed;
+            rng = gen::rng(gen::splitmix64(state) ^ (n.value / block));
+            for(size_t i = 0; i < n.value % block; ++i)
+                dist(rng);
+            synced = true;
+        }
+
+        std::optional<value_type> operator()() const
+        {
+            if (!remaining())
+                return std::nullopt;
+            if (!synced || n.value % block == 0)
+                sync();
+            ++n.value;
+            return dist(rng);
+        }
+
+        size_t advance(size_t count) const
+        {
+            count = std::min(count, remaining());
+            if (count)
+            {
+                n.value += count;
+                synced = false;
+            }
+            return count;
+        }
+
+        std::optional<size_t> size_hint() const
+        {
+            return remaining();
+        }
+
+        // Endless generators aren't split
+        std::optional<generator_fn> try_split() const
+        {
+            if (size == SIZE_MAX)
+                return std::nullopt;
+            size_t const half = (n.value + remaining() / 2) / block * block;
+            if (half <= n.value)
+                return std::nullopt;
+            generator_fn prefix{ dist, seed, half, n, rng, synced };
+            n.value = half;
+            synced = false;
+            return prefix;
+        }
+    };
+
+    // Timestamps (ns) of 'size' arrivals of Process, starting at 'start'.
+    // Every timestamp depends on all previous ones, so these streams aren't split.
+    template<typename Process>
+    struct arrivals_fn
+    {
+        mutable Process process;
+        mutable gen::rng rng;
+        size_t size;
+        mutable_idx n;
+        mutable double time;
+
+        std::optional<uint64_t> operator()() const
+        {
+            if (size != SIZE_MAX && n.value == size)
+                return std::nullopt;
+            ++n.value;
+            time += process.gap(rng);
+            return static_cast<uint64_t>(time);
+        }
+
+        std::optional<size_t> size_hint() const
+        {
+            return size == SIZE_MAX ? SIZE_MAX : size - n.value;
+        }
+    };
+}
+
+namespace plusar::gen
+{
+    // Stream of 'count' values drawn from dist(rng &)
+    template<typename Dist>
+    auto generate(Dist dist, size_t count = SIZE_MAX, uint64_t seed = 0)
+    {
+        return internal::make_stage("generate", internal::generator_fn<Dist>{ std::move(dist), seed, count, internal::mutable_idx{}, rng{}, false });
+    }
+
+    inline auto uniform(uint64_t keys, size_t count = SIZE_MAX, uint64_t seed = 0)
+    {
+        return generate(uniform_keys{ keys }, count, seed);
+    }
+
+    inline auto zipf(uint64_t keys, double exponent, size_t count = SIZE_MAX, uint64_t seed = 0)
+    {
+        return generate(zipf_keys(keys, exponent), count, seed);
+    }
+
+    inline auto payload(size_t min_size, size_t max_size, size_t count = SIZE_MAX, uint64_t seed = 0)
+    {
+        return generate(payloads{ min_size, std::max(min_size, max_size) }, count, seed);
+    }
+
+    // Stream of 'count' timestamps (ns) of the arrival process
+    template<typename Process>
+    auto arrivals(Process process, size_t count = SIZE_MAX, uint64_t seed = 0, uint64_t start = 0)
+    {
+        return internal::make_stage("arrivals", internal::arrivals_fn<Process>{ std::move(process), rng(seed), count, internal::mutable_idx{}, static_cast<double>(start) });
+    }
+
+    inline auto poisson(double rate, size_t count = SIZE_MAX, uint64_t seed = 0, uint64_t start = 0)
+    {
+        return arrivals(poisson_process(rate), count, seed, start);
+    }
+
+    inline auto bursty(double rate, double burst_rate, double burst_size, size_t count = SIZE_MAX, uint64_t seed = 0, uint64_t start = 0)
+    {
+        return arrivals(bursty_process(rate, burst_rate, burst_size), count, seed, start);
+    }
+}
@@ -0,0 +1,252 @@
+#pragma once
+#include <plusar/stream.hpp>
+#include <algorithm>
+#include <optional>
+#include <ostream>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <limits>
+#include <cstdint>
+#include <cstddef>
+
+#if __has_include(<bit>)
+#   include <bit>
+#endif
+
+namespace plusar
+{
+    // Fixed memory, log-linear (HDR style) histogram of 64 bit values.
+    // Values below 2^SubBucketBits are counted exactly, larger ones with relative error below 2^-(SubBucketBits - 1).
+    // Recording is lock-free and may happen from any number of threads.
+    template<unsigned SubBucketBits>
+    class basic_histogram
+    {
+        static_assert(SubBucketBits >= 2 && SubBucketBits < 32, "unsupported precision");
+
+        static constexpr uint64_t linear = uint64_t{ 1 } << SubBucketBits;           // exactly counted values
+        static constexpr uint64_t half = linear / 2;                                // sub-buckets per power of two above
+        static constexpr size_t   buckets = linear + (64 - SubBucketBits) * half;
+
+        std::unique_ptr<std::atomic<uint64_t>[]> _counts;
+        std::atomic<uint64_t>                    _total{ 0 };
+        std::atomic<uint64_t>                    _sum{ 0 };
+        std::atomic<uint64_t>                    _min{ std::numeric_limits<uint64_t>::max() };
+        std::atomic<uint64_t>                    _max{ 0 };
+
+        basic_histogram(basic_histogram const &) = delete;
+        basic_histogram & operator = (basic_histogram const &) = delete;
+
+        // Index of the highest set bit of a non-zero value
+        static unsigned msb(uint64_t v)
+        {
+#if defined(__cpp_lib_bitops)
+            return static_cast<unsigned>(63 - std::countl_zero(v));
+#elif defined(__GNUC__) || defined(__clang__)
+            return static_cast<unsigned>(63 - __builtin_clzll(v));
+#else
+            unsigned n = 0;
+            while(v >>= 1)
+                ++n;
+            return n;
+#endif
+        }
+
+        static size_t index(uint64_t v)
+        {
+            if (v < linear)
+                return static_cast<size_t>(v);
+            unsigned const shift = msb(v) - SubBucketBits + 1;
+            return static_cast<size_t>(linear + (shift - 1) * half + ((v >> shift) - half));
+        }
+
+        // Highest value counted by the bucket
+        static uint64_t highest_value(size_t i)
+        {
+            if (i < linear)
+                return i;
+            unsigned const shift = static_cast<unsigned>((i - linear) / half + 1);
+            uint64_t const sub = (i - linear) % half + half;
+            return ((sub + 1) << shift) - 1;
+        }
+
+    public:
+        basic_histogram():
+            _counts(new std::atomic<uint64_t>[buckets])
+        {
+            reset();
+        }
+
+        void record(uint64_t value, uint64_t count = 1)
+        {
+            _counts[index(value)].fetch_add(count, std::memory_order_relaxed);
+            _total.fetch_add(count, std::memory_order_relaxed);
+            _sum.fetch_add(value * count, std::memory_order_relaxed);
+
+            for(uint64_t m = _min.load(std::memory_order_relaxed); value < m && !_min.compare_exchange_weak(m, value, std::memory_order_relaxed););
+            for(uint64_t m = _max.load(std::memory_order_relaxed); value > m && !_max.compare_exchange_weak(m, value, std::memory_order_relaxed););
+        }
+
+        uint64_t count() const
+        {
+            return _total.load(std::memory_order_relaxed);
+        }
+
+        uint64_t min() const
+        {
+            return count() ? _min.load(std::memory_order_relaxed) : 0;
+        }
+
+        uint64_t max() const
+        {
+            return _max.load(std::memory_order_relaxed);
+        }
+
+        double mean() const
+        {
+            auto const n = count();
+            return n ? static_cast<double>(_sum.load(std::memory_order_relaxed)) / n : 0.0;
+        }
+
+        // Smallest recorded value (up to the bucket precision) which isn't exceeded by the given percentage of values
+        uint64_t percentile(double p) const
+        {
+            uint64_t const total = count();
+            if (!total)
+                return 0;
+
+            p = std::clamp(p, 0.0, 100.0);
+            uint64_t const rank = std::max<uint64_t>(1, static_cast<uint64_t>(p / 100.0 * total + 0.5));
+
+            uint64_t seen = 0;
+            for(size_t i = 0; i < buckets; ++i)
+            {
+                seen += _counts[i].load(std::memory_order_relaxed);
+                if (seen >= rank)
+                    return std::min(highest_value(i), max());
+            }
+            return max();
+        }
+
+        void merge(basic_histogram const &other)
+        {
+            for(size_t i = 0; i < buckets; ++i)
+                if (auto n = other._counts[i].load(std::memory_order_relaxed))
+                    _counts[i].fetch_add(n, std::memory_order_relaxed);
+
+            _total.fetch_add(other.count(), std::memory_order_relaxed);
+            _sum.fetch_add(other._sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+            if (other.count())
+            {
+                uint64_t const lo = other.min(), hi = other.max();
+                for(uint64_t m = _min.load(std::memory_order_relaxed); lo < m && !_min.compare_exchange_weak(m, lo, std::memory_order_relaxed););
+                for(uint64_t m = _max.load(std::memory_order_relaxed); hi > m && !_max.compare_exchange_weak(m, hi, std::memory_order_relaxed););
+            }
+        }
+
+        void reset()
+        {
+            for(size_t i = 0; i < buckets; ++i)
+                _counts[i].store(0, std::memory_order_relaxed);
+            _total = 0;
+            _sum = 0;
+            _min = std::numeric_limits<uint64_t>::max();
+            _max = 0;
+        }
+
+        // Summary percentiles and non-empty buckets as a JSON object
+        void to_json(std::ostream &os) const
+        {
+            os << "{\"count\":" << count()
+               << ",\"min\":" << min()
+               << ",\"max\":" << max()
+               << ",\"mean\":" << mean()
+               << ",\"p50\":" << percentile(50)
+               << ",\"p90\":" << percentile(90)
+               << ",\"p99\":" << percentile(99)
+               << ",\"p999\":" << percentile(99.9)
+               << ",\"buckets\":[";
+
+            bool first = true;
+            for(size_t i = 0; i < buckets; ++i)
+            {
+                if (auto n = _counts[i].load(std::memory_order_relaxed))
+                {
+                    os << (first ? "" : ",") << '[' << highest_value(i) << ',' << n << ']';
+                    first = false;
+                }
+            }
+            os << "]}";
+        }
+    };
+
+    namespace internal
+    {
+        using ingest_time = std::optional<std::chrono::steady_clock::time_point>;
+
+        // Ingest time kept by the record_latency stage being pulled on this thread. mark_ingest stages upstream
+        // of it store to this slot, so every pipeline accounts its own elements.
+        inline ingest_time *& ingest_slot()
+        {
+            thread_local ingest_time *slot = nullptr;
+            return slot;
+        }
+
+        template<typename Src>
+        struct mark_ingest_fn
+        {
+            Src src;
+
+            std::optional<typename Src::type> operator()() const
+            {
+                auto v = src.next();
+                if (auto *ingest = ingest_slot(); v && ingest && !*ingest)
+                    *ingest = std::chrono::steady_clock::now();
+                return v;
+            }
+        };
+
+        template<typename Src>
+        struct record_latency_fn
+        {
+            // Makes the ingest time of this stage the slot while the source is pulled
+            struct scope
+            {
+                ingest_time *outer;
+
+                explicit scope(ingest_time &ingest):
+                    outer(ingest_slot())
+                {
+                    ingest_slot() = &ingest;
+                }
+
+                ~scope()
+                {
+                    ingest_slot() = outer;
+                }
+            };
+
+            Src src;
+            latency_histogram *histogram;
+            mutable ingest_time ingest;         // of the oldest element which hasn't been accounted to an emitted one yet
+
+            std::optional<typename Src::type> operator()() const
+            {
+                auto v = [this]()
+                {
+                    scope pulling(ingest);
+                    return src.next();
+                }();
+
+                if (v && ingest)
+                {
+                    auto const latency = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - *ingest);
+                    histogram->record(static_cast<uint64_t>(latency.count()));
+                }
+                ingest.reset();
+                return v;
+            }
+        };
+    }
+}
@@ -0,0 +1,270 @@
+#pragma once
+#include <type_traits>
+#include <algorithm>
+#include <optional>
+#include <utility>
+#include <ostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <memory>
+#include <typeindex>
+#include <typeinfo>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+#include <plusar/trace.hpp>
+
+// Per-stage counters of stream pipelines. Stages are instrumented when PLUSAR_INSTRUMENT is defined,
+// otherwise the stage types are left untouched and the report is empty.
+namespace plusar::instrument
+{
+    struct stage_report
+    {
+        size_t      id;             // stages are numbered in the order of first construction, sources first
+        std::string name;
+        uint64_t    pulls;          // next() calls
+        uint64_t    in;             // elements received from the upstream stage
+        uint64_t    out;            // elements produced
+        double      total_ms;       // time spent inside the stage, including upstream stages
+        double      self_ms;        // time spent inside the stage itself
+    };
+
+    namespace internal
+    {
+        struct stage_stats
+        {
+            size_t                id;
+            char const           *name;
+            std::type_index       type;
+            std::atomic<uint64_t> pulls{ 0 };
+            std::atomic<uint64_t> in{ 0 };
+            std::atomic<uint64_t> out{ 0 };
+            std::atomic<uint64_t> total_ns{ 0 };
+            std::atomic<uint64_t> self_ns{ 0 };
+
+            stage_stats(size_t id, char const *name, std::type_index type):
+                id(id),
+                name(name),
+                type(type)
+            {}
+        };
+
+        // Stages of the same type and name share their counters, so stages built per element or per run
+        // (inner streams of flatten, readers of sorted runs) don't grow the registry
+        struct registry
+        {
+            std::mutex                                mutex;
+            std::vector<std::shared_ptr<stage_stats>> stages;
+            std::atomic<uint64_t>                     generation{ 0 };     // incremented by reset
+            size_t                                    next_id = 0;
+
+            static registry & instance()
+            {
+                static registry r;
+                return r;
+            }
+
+            std::shared_ptr<stage_stats> add(char const *name, std::type_index type)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for(auto const &s : stages)
+                    if (s->type == type && !std::strcmp(s->name, name))
+                        return s;
+
+                auto stats = std::make_shared<stage_stats>(next_id++, name, type);
+                stages.push_back(stats);
+                return stats;
+            }
+        };
+
+        // Counters of the stages of type Stage, looked up in the registry once per thread until it's reset
+        template<typename Stage>
+        std::shared_ptr<stage_stats> stats_of(char const *name)
+        {
+            thread_local std::shared_ptr<stage_stats> cached;
+            thread_local uint64_t generation = 0;
+
+            auto &r = registry::instance();
+            auto const current = r.generation.load(std::memory_order_acquire);
+            if (!cached || generation != current || cached->name != name)
+            {
+                cached = r.add(name, typeid(Stage));
+                generation = current;
+            }
+            return cached;
+        }
+
+        // Active stage invocations of the current thread, innermost first
+        struct frame
+        {
+            stage_stats                          *stats;
+            frame                                *parent;
+            std::chrono::steady_clock::time_point start;
+            uint64_t                              child_ns = 0;
+        };
+
+        inline frame *& current_frame()
+        {
+            thread_local frame *current = nullptr;
+            return current;
+        }
+
+        class scope
+        {
+            trace::span _span;
+            frame       _frame;
+            bool        _left = false;
+
+            scope(scope const &) = delete;
+            scope & operator = (scope const &) = delete;
+
+        public:
+            scope(stage_stats *stats, char const *category):
+                _span(stats->name, category),
+                _frame{ stats, current_frame(), std::chrono::steady_clock::now() }
+            {
+                stats->pulls.fetch_add(1, std::memory_order_relaxed);
+                current_frame() = &_frame;
+            }
+
+            void leave(uint64_t produced)
+            {
+                auto const elapsed = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _frame.start).count());
+                auto *stats = _frame.stats;
+
+                stats->out.fetch_add(produced, std::memory_order_relaxed);
+                stats->total_ns.fetch_add(elapsed, std::memory_order_relaxed);
+                stats->self_ns.fetch_add(elapsed - std::min(elapsed, _frame.child_ns), std::memory_order_relaxed);
+
+                if (auto *parent = _frame.parent)
+                {
+                    parent->child_ns += elapsed;
+                    parent->stats->in.fetch_add(produced, std::memory_order_relaxed);
+                }
+
+                current_frame() = _frame.parent;
+                _left = true;
+            }
+
+            ~scope()
+            {
+                if (!_left)
+                    leave(0);
+            }
+        };
+    }
+
+    constexpr bool enabled =
+#ifdef PLUSAR_INSTRUMENT
+        true;
+#else
+        false;
+#endif
+
+    // Counters of the stages which have been pulled at least once. Stages of the same type share a report,
+    // like the inner streams of a flatten stage.
+    inline std::vector<stage_report> report()
+    {
+        auto &r = internal::registry::instance();
+        std::lock_guard<std::mutex> lock(r.mutex);
+
+        std::vector<stage_report> res;
+        for(auto const &s : r.stages)
+        {
+            if (!s->pulls)
+                continue;
+            res.push_back(stage_report{ s->id, s->name, s->pulls, s->in, s->out, s->total_ns / 1e6, s->self_ns / 1e6 });
+        }
+        return res;
+    }
+
+    inline void print_report(std::ostream &os)
+    {
+        os << std::left << std::setw(6) << "id" << std::setw(16) << "stage"
+           << std::right << std::setw(14) << "pulls" << std::setw(14) << "in" << std::setw(14) << "out"
+           << std::setw(14) << "total ms" << std::setw(14) << "self ms" << '\n';
+
+        for(auto const &s : report())
+            os << std::left << std::setw(6) << s.id << std::setw(16) << s.name
+               << std::right << std::setw(14) << s.pulls << std::setw(14) << s.in << std::setw(14) << s.out
+               << std::fixed << std::setprecision(3) << std::setw(14) << s.total_ms << std::setw(14) << s.self_ms << '\n';
+    }
+
+    // Forgets all stages
+    inline void reset()
+    {
+        auto &r = internal::registry::instance();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        r.stages.clear();
+        r.generation.fetch_add(1, std::memory_order_release);
+    }
+}
+
+namespace plusar::internal
+{
+    // Stage wrapped with counters. Capabilities of the stage are inherited, splits share the counters.
+    template<typename Stage>
+    struct probed : Stage
+    {
+        std::shared_ptr<instrument::internal::stage_stats> stats;
+
+        probed(Stage &&stage, char const *name):
+            Stage(std::move(stage)),
+            stats(instrument::internal::stats_of<Stage>(name))
+        {}
+
+        probed(Stage &&stage, std::shared_ptr<instrument::internal::stage_stats> stats):
+            Stage(std::move(stage)),
+            stats(std::move(stats))
+        {}
+
+        auto operator()() const -> decltype(std::declval<Stage const &>()())
+        {
+            instrument::internal::scope scope(stats.get(), "stage");
+            auto v = Stage::operator()();
+            scope.leave(v ? 1 : 0);
+            return v;
+        }
+
+        template<typename T, typename S = Stage>
+        auto next_batch(T *out, size_t n) const -> decltype(std::declval<S const &>().next_batch(out, n))
+        {
+            instrument::internal::scope scope(stats.get(), "batch");
+            size_t const count = Stage::next_batch(out, n);
+            scope.leave(count);
+            return count;
+        }
+
+        template<typename T, typename S = Stage>
+        auto next_until(std::optional<T> &out, std::chrono::steady_clock::time_point deadline) const -> decltype(std::declval<S const &>().next_until(out, deadline))
+        {
+            instrument::internal::scope scope(stats.get(), "stage");
+            auto const status = Stage::next_until(out, deadline);
+            scope.leave(status == std::decay_t<decltype(status)>::ready ? 1 : 0);     // pull_status is declared after this header
+            return status;
+        }
+
+        template<typename S = Stage>
+        auto try_split() const -> std::optional<std::enable_if_t<std::is_same<decltype(std::declval<S const &>().try_split()), std::optional<S>>::value, probed>>
+        {
+            auto part = Stage::try_split();
+            return part ? std::make_optional(probed(std::move(*part), stats)) : std::nullopt;
+        }
+    };
+
+    template<typename Fn>
+    struct stage
+    {
+        using type = Fn;
+    };
+
+    template<typename Fn>
+    struct stage<probed<Fn>>
+    {
+        using type = Fn;
+    };
+}
@@ -0,0 +1,130 @@
+#pragma once
+#include <memory_resource>
+#include <algorithm>
+#include <memory>
+#include <cstddef>
+
+// Memory resources for stateful stages (tee, cache), which take a std::pmr::memory_resource.
+// flatten and flat_map don't take one: the inner stream is built in place in the stage, and the buffer
+// filled by a flat_map function is a std::vector which keeps its capacity from one element to the next.
+namespace plusar
+{
+    // Monotonic resource for state living as long as a window, a batch or a pass.
+    // Allocation moves a pointer through blocks taken from the upstream resource, deallocation does nothing.
+    // reset() frees everything at once and keeps the blocks, so once the arena has grown to the size of
+    // the largest window it doesn't call the upstream resource anymore. Not thread safe.
+    class arena : public std::pmr::memory_resource
+    {
+        struct block
+        {
+            block  *next;
+            size_t  size;       // bytes after the header
+        };
+
+        static constexpr size_t header = (sizeof(block) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+
+        std::pmr::memory_resource *_upstream;
+        size_t                     _next_size;
+        block                     *_head = nullptr;
+        block                     *_tail = nullptr;
+        block                     *_current = nullptr;
+        char                      *_ptr = nullptr;
+        char                      *_end = nullptr;
+        size_t                     _reserved = 0;
+
+        arena(arena const &) = delete;
+        arena & operator = (arena const &) = delete;
+
+        void use(block *b)
+        {
+            _current = b;
+            _ptr = reinterpret_cast<char *>(b) + header;
+            _end = _ptr + b->size;
+        }
+
+        void * do_allocate(size_t bytes, size_t alignment) override
+        {
+            for(;;)
+            {
+                void *p = _ptr;
+                size_t space = static_cast<size_t>(_end - _ptr);
+                if (_ptr && std::align(alignment, bytes, p, space))
+                {
+                    _ptr = static_cast<char *>(p) + bytes;
+                    return p;
+                }
+
+                // Blocks kept by reset() are reused in order, a block too small for this request is skipped
+                if (block *next = _current ? _current->next : _head)
+                {
+                    use(next);
+                    continue;
+                }
+
+                size_t const size = std::max(_next_size, bytes + alignment);
+                auto *b = static_cast<block *>(_upstream->allocate(header + size, alignof(std::max_align_t)));
+                b->next = nullptr;
+                b->size = size;
+                (_tail ? _tail->next : _head) = b;
+                _tail = b;
+                _reserved += size;
+                _next_size = size * 2;
+                use(b);
+            }
+        }
+
+        void do_deallocate(void *, size_t, size_t) override
+        {}
+
+        bool do_is_equal(std::pmr::memory_resource const &other) const noexcept override
+        {
+            return this == &other;
+        }
+
+    public:
+        explicit arena(size_t initial_size = 64 * 1024, std::pmr::memory_resource *upstream = std::pmr::get_default_resource()):
+            _upstream(upstream),
+            _next_size(std::max<size_t>(initial_size, 64))
+        {}
+
+        ~arena()
+        {
+            release();
+        }
+
+        // Frees all allocations and keeps the blocks for the following ones
+        void reset()
+        {
+            _current = nullptr;
+            _ptr = _end = nullptr;
+        }
+
+        // Frees all allocations and returns the blocks to the upstream resource
+        void release()
+        {
+            while(_head)
+            {
+                block *next = _head->next;
+                _upstream->deallocate(_head, header + _head->size, alignof(std::max_align_t));
+                _head = next;
+            }
+            _tail = nullptr;
+            _reserved = 0;
+            reset();
+        }
+
+        // Bytes taken from the upstream resource
+        size_t bytes_reserved() const
+        {
+            return _reserved;
+        }
+    };
+
+    // Pool resource of the calling thread, released when the thread exits.
+    // Memory from it must be allocated and deallocated on that thread.
+    inline std::pmr::memory_resource * thread_local_pool()
+    {
+        thread_local std::pmr::unsynchronized_pool_resource pool;
+        return &pool;
+    }
+}
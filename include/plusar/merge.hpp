@@ -0,0 +1,310 @@
+#pragma once
+#include <plusar/stream.hpp>
+#include <type_traits>
+#include <functional>
+#include <algorithm>
+#include <optional>
+#include <utility>
+#include <vector>
+#include <array>
+#include <tuple>
+
+namespace plusar
+{
+    namespace internal
+    {
+        constexpr size_t dynamic_inputs = SIZE_MAX;
+
+        // K-way merge by a loser tree. Every node keeps the input which lost the match played there, the overall
+        // winner is kept in node 0, so replacing the winner replays log2(k) matches along its path only.
+        // Inputs are read in batches into per-input buffers. Ties go to the input listed first, so the merge is stable.
+        // Inputs is a tuple of streams (K of them) or a vector of streams (K is dynamic_inputs).
+        template<typename T, typename Cmp, typename Inputs, size_t K>
+        struct merge_fn
+        {
+            static constexpr size_t batch = std::max<size_t>(1, 256 / sizeof(T));
+
+            template<typename X>
+            using slots = std::conditional_t<K == dynamic_inputs, std::vector<X>, std::array<X, K == dynamic_inputs ? 1 : K>>;
+
+            struct buffer
+            {
+                std::array<T, batch> items;
+                size_t               pos = 0;
+                size_t               size = 0;
+            };
+
+            Inputs srcs;
+            Cmp cmp;
+            mutable slots<buffer> buffers;
+            mutable slots<T *> heads{};         // current element of every input, nullptr once it's exhausted
+            mutable slots<size_t> tree{};       // tree[0] is the winner, tree[1..k) the losers
+            mutable bool started = false;
+
+            merge_fn(Inputs srcs, Cmp cmp):
+                srcs(std::move(srcs)),
+                cmp(std::move(cmp))
+            {
+                if constexpr (K == dynamic_inputs)
+                {
+                    buffers.resize(this->srcs.size());
+                    heads.resize(this->srcs.size());
+                    tree.resize(std::max<size_t>(this->srcs.size(), 1));
+                }
+            }
+
+            merge_fn(merge_fn const &other):
+                srcs(other.srcs),
+                cmp(other.cmp),
+                buffers(other.buffers),
+                heads(other.heads),
+                tree(other.tree),
+                started(other.started)
+            {
+                rebase();
+            }
+
+            merge_fn(merge_fn &&other):
+                srcs(std::move(other.srcs)),
+                cmp(std::move(other.cmp)),
+                buffers(std::move(other.buffers)),
+                heads(std::move(other.heads)),
+                tree(std::move(other.tree)),
+                started(other.started)
+            {
+                rebase();
+            }
+
+            // Points the heads to the buffers of this copy
+            void rebase()
+            {
+                for(size_t i = 0; i < heads.size(); ++i)
+                {
+                    if (heads[i])
+                        heads[i] = buffers[i].items.data() + buffers[i].pos;
+                }
+            }
+
+            size_t inputs() const
+            {
+                if constexpr (K == dynamic_inputs)
+                    return srcs.size();
+                else
+                    return K;
+            }
+
+            template<size_t I = 0>
+            size_t pull(size_t i, T *out) const
+            {
+                if constexpr (K == dynamic_inputs)
+                    return srcs[i].next_batch(out, batch);
+                else
+                {
+                    if constexpr (I + 1 < K)
+                    {
+                        if (i != I)
+                            return pull<I + 1>(i, out);
+                    }
+                    return std::get<I>(srcs).next_batch(out, batch);
+                }
+            }
+
+            bool exhausted(size_t i) const
+            {
+                return !heads[i];
+            }
+
+            // Element x of input a goes before element y of input b. Exhausted inputs (nullptr) lose every match,
+            // equal elements go to the lower input.
+            bool wins(T const *x, size_t a, T const *y, size_t b) const
+            {
+                if (!x | !y)
+                    return x != nullptr;
+                if constexpr (std::is_arithmetic<T>::value)
+                {
+                    // Both cheap comparisons are made, so the outcome doesn't wait on a mispredicted branch
+                    bool const less = cmp(*x, *y);
+                    bool const greater = cmp(*y, *x);
+                    return less | (!greater & (a < b));
+                }
+                else
+                    return a < b ? !cmp(*y, *x) : cmp(*x, *y);
+            }
+
+            bool beats(size_t a, size_t b) const
+            {
+                return wins(heads[a], a, heads[b], b);
+            }
+
+            void refill(size_t i) const
+            {
+                auto &b = buffers[i];
+                b.pos = 0;
+                b.size = pull(i, b.items.data());
+                heads[i] = b.size ? b.items.data() : nullptr;
+            }
+
+            // Plays all matches bottom up. Node n has children 2n and 2n + 1, input i is the leaf k + i.
+            void start() const
+            {
+                size_t const k = inputs();
+                for(size_t i = 0; i < k; ++i)
+                    refill(i);
+                started = true;
+                if (k < 2)
+                {
+                    tree[0] = 0;
+                    return;
+                }
+
+                std::vector<size_t> winners(2 * k);
+                for(size_t i = 0; i < k; ++i)
+                    winners[k + i] = i;
+                for(size_t n = k - 1; n > 0; --n)
+                {
+                    size_t const a = winners[2 * n], b = winners[2 * n + 1];
+                    bool const a_wins = beats(a, b);
+                    winners[n] = a_wins ? a : b;
+                    tree[n] = a_wins ? b : a;
+                }
+                tree[0] = winners[1];
+            }
+
+            // Replays the matches on the path of input i after its head changed
+            void replay(size_t i) const
+            {
+                T * const *h = heads.data();
+                size_t *t = tree.data();
+                size_t winner = i;
+                for(size_t n = (inputs() + i) / 2; n > 0; n /= 2)
+                {
+                    size_t const loser = t[n];
+                    bool const swap = wins(h[loser], loser, h[winner], winner);
+                    t[n] = swap ? winner : loser;
+                    winner = swap ? loser : winner;
+                }
+                t[0] = winner;
+            }
+
+            // Moves input w to its next element after its head was taken
+            void pop(size_t w) const
+            {
+                auto &b = buffers[w];
+                if (++b.pos == b.size)
+                    refill(w);
+                else
+                    ++heads[w];
+                replay(w);
+            }
+
+            std::optional<T> operator()() const
+            {
+                if (!started)
+                    start();
+                if (!inputs())
+                    return std::nullopt;
+
+                size_t const w = tree[0];
+                if (exhausted(w))
+                    return std::nullopt;
+
+                std::optional<T> v(std::move(*heads[w]));
+                pop(w);
+                return v;
+            }
+
+            size_t next_batch(T *out, size_t count) const
+            {
+                if (!started)
+                    start();
+                if (!inputs())
+                    return 0;
+
+                size_t n = 0;
+                for(; n < count; ++n)
+                {
+                    size_t const w = tree[0];
+                    if (exhausted(w))
+                        break;
+                    out[n] = std::move(*heads[w]);
+                    pop(w);
+                }
+                return n;
+            }
+
+            template<size_t I = 0>
+            std::optional<size_t> remaining(size_t i) const
+            {
+                if constexpr (K == dynamic_inputs)
+                    return srcs[i].size_hint();
+                else
+                {
+                    if constexpr (I + 1 < K)
+                    {
+                        if (i != I)
+                            return remaining<I + 1>(i);
+                    }
+                    return std::get<I>(srcs).size_hint();
+                }
+            }
+
+            // Sum of the remaining elements of the inputs
+            std::optional<size_t> size_hint() const
+            {
+                size_t total = 0;
+                for(size_t i = 0; i < inputs(); ++i)
+                {
+                    auto const size = remaining(i);
+                    if (!size)
+                        return std::nullopt;
+                    total = saturating_add(total, *size);
+                    if (started && !exhausted(i))
+                        total = saturating_add(total, buffers[i].size - buffers[i].pos);
+                }
+                return total;
+            }
+        };
+
+        template<typename T>
+        struct is_stream : std::false_type {};
+
+        template<typename Fn>
+        struct is_stream<stream<Fn>> : std::true_type {};
+
+        template<typename Cmp, typename... Srcs>
+        auto make_merge(Cmp cmp, std::tuple<Srcs...> srcs)
+        {
+            using T = typename std::tuple_element_t<0, std::tuple<Srcs...>>::type;
+            static_assert((std::is_same<typename Srcs::type, T>::value && ...), "merged streams must have the same element type");
+            return make_stage("merge_sorted", merge_fn<T, Cmp, std::tuple<Srcs...>, sizeof...(Srcs)>(std::move(srcs), std::move(cmp)));
+        }
+
+        template<typename Tuple, size_t... I>
+        auto make_merge_by_last(Tuple &&args, std::index_sequence<I...>)
+        {
+            return make_merge(std::get<sizeof...(I)>(args), std::make_tuple(std::get<I>(args)...));
+        }
+    }
+
+    // Merges streams sorted by cmp into one sorted stream. The comparator is the last argument and may be omitted
+    // (std::less<>). Elements must be default constructible, inputs are read in batches of about 256 bytes.
+    template<typename... Args>
+    auto merge_sorted(Args const &... args)
+    {
+        static_assert(sizeof...(Args) > 0, "merge_sorted requires streams");
+        using last = std::tuple_element_t<sizeof...(Args) - 1, std::tuple<Args...>>;
+
+        if constexpr (internal::is_stream<last>::value)
+            return internal::make_merge(std::less<>(), std::make_tuple(args...));
+        else
+            return internal::make_merge_by_last(std::forward_as_tuple(args...), std::make_index_sequence<sizeof...(Args) - 1>());
+    }
+
+    // Merges a number of streams known at run time
+    template<typename Fn, typename Cmp = std::less<>>
+    auto merge_sorted(std::vector<stream<Fn>> srcs, Cmp cmp = Cmp{})
+    {
+        using T = typename stream<Fn>::type;
+        return internal::make_stage("merge_sorted", internal::merge_fn<T, Cmp, std::vector<stream<Fn>>, internal::dynamic_inputs>(std::move(srcs), std::move(cmp)));
+    }
+}
@@ -0,0 +1,289 @@
+#pragma once
+#include <plusar/stream.hpp>
+#include <plusar/trace.hpp>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <memory>
+
+namespace plusar
+{
+    // Fixed size pool of worker threads
+    class thread_pool
+    {
+        std::vector<std::thread>          _workers;
+        std::deque<std::function<void()>> _tasks;
+        std::mutex                        _mutex;
+        std::condition_variable           _cv;
+        bool                              _stop = false;
+
+        thread_pool(thread_pool const &) = delete;
+        thread_pool & operator = (thread_pool const &) = delete;
+
+        void run()
+        {
+            for(;;)
+            {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _cv.wait(lock, [this] { return _stop || !_tasks.empty(); });
+                    if (_tasks.empty())
+                        return;
+                    task = std::move(_tasks.front());
+                    _tasks.pop_front();
+                }
+                task();
+            }
+        }
+
+    public:
+        explicit thread_pool(size_t workers = std::thread::hardware_concurrency())
+        {
+            workers = std::max<size_t>(workers, 1);
+            for(size_t i = 0; i < workers; ++i)
+                _workers.emplace_back([this] { run(); });
+        }
+
+        ~thread_pool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stop = true;
+            }
+            _cv.notify_all();
+            for(auto &w : _workers)
+                w.join();
+        }
+
+        size_t size() const
+        {
+            return _workers.size();
+        }
+
+        template<typename F>
+        auto submit(F && fn)
+        {
+            using result = std::invoke_result_t<std::decay_t<F>>;
+            auto task = std::make_shared<std::packaged_task<result()>>(std::forward<F>(fn));
+            auto future = task->get_future();
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _tasks.emplace_back([task, queued = trace::now()]
+                {
+                    trace::complete("queue wait", "queue", queued);
+                    trace::span span("task", "pool");
+                    (*task)();
+                });
+            }
+            _cv.notify_one();
+            return future;
+        }
+
+        // Library wide pool sized by the hardware concurrency
+        static thread_pool & shared()
+        {
+            static thread_pool pool;
+            return pool;
+        }
+    };
+
+    namespace internal
+    {
+        // Upstream is pulled on the consumer thread only, workers evaluate fn.
+        // Memory is bounded by the window: results in flight plus results waiting to be emitted.
+        template<typename Src, typename FnR, bool Ordered>
+        struct parallel_map_fn
+        {
+            using source_type = typename Src::type;
+            using result_type = std::decay_t<std::invoke_result_t<FnR const &, source_type const &>>;
+
+            struct state
+            {
+                FnR                             fn;
+                size_t                          window;
+                std::deque<std::future<result_type>> results;     // in source order, or in completion order when unordered
+                size_t                          in_flight = 0;
+                bool                            exhausted = false;
+                std::mutex                      mutex;
+                std::condition_variable         ready;
+                thread_pool                     pool;           // the last member, so it's joined first
+
+                state(FnR const &fn, size_t workers, size_t window):
+                    fn(fn),
+                    window(window),
+                    pool(workers)
+                {}
+            };
+
+            Src src;
+            FnR fn;
+            size_t workers;
+            size_t window;
+            mutable std::shared_ptr<state> st;
+
+            parallel_map_fn(Src const &src, FnR fn, size_t workers, size_t window):
+                src(src),
+                fn(std::move(fn)),
+                workers(workers ? workers : std::max(std::thread::hardware_concurrency(), 1u)),
+                window(window ? window : this->workers * 4)
+            {}
+
+            parallel_map_fn(parallel_map_fn const &other):
+                src(other.src),
+                fn(other.fn),
+                workers(other.workers),
+                window(other.window)
+            {}
+
+            void submit(source_type &&v) const
+            {
+                state *s = st.get();
+
+                if constexpr (Ordered)
+                {
+                    s->results.push_back(s->pool.submit([s, v = std::move(v)]() { return s->fn(v); }));
+                }
+                else
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(s->mutex);
+                        ++s->in_flight;
+                    }
+
+                    s->pool.submit([s, v = std::move(v)]()
+                    {
+                        std::promise<result_type> result;
+                        try
+                        {
+                            result.set_value(s->fn(v));
+                        }
+                        catch(...)
+                        {
+                            result.set_exception(std::current_exception());
+                        }
+
+                        {
+                            std::lock_guard<std::mutex> lock(s->mutex);
+                            --s->in_flight;
+                            s->results.push_back(result.get_future());
+                        }
+                        s->ready.notify_one();
+                    });
+                }
+            }
+
+            size_t pending() const
+            {
+                std::lock_guard<std::mutex> lock(st->mutex);
+                return st->in_flight + st->results.size();
+            }
+
+            std::optional<result_type> operator()() const
+            {
+                if (!st)
+                    st = std::make_shared<state>(fn, workers, window);
+
+                while(!st->exhausted && pending() < st->window)
+                {
+                    auto v = src.next();
+                    if (!v)
+                        st->exhausted = true;
+                    else
+                        submit(std::move(*v));
+                }
+
+                trace::span span("parallel_map wait", "queue");
+
+                std::unique_lock<std::mutex> lock(st->mutex);
+                if constexpr (!Ordered)
+                    st->ready.wait(lock, [this] { return !st->results.empty() || !st->in_flight; });
+
+                if (st->results.empty())
+                    return std::nullopt;
+
+                auto result = std::move(st->results.front());
+                st->results.pop_front();
+                lock.unlock();
+
+                return result.get();
+            }
+        };
+
+        template<typename S>
+        void split_parts(S part, size_t depth, std::vector<S> &parts, size_t grain)
+        {
+            if (depth && part.estimated_size() > grain)
+            {
+                if (auto prefix = part.try_split())
+                {
+                    split_parts(std::move(*prefix), depth - 1, parts, grain);
+                    split_parts(std::move(part), depth - 1, parts, grain);
+                    return;
+                }
+            }
+            parts.push_back(std::move(part));
+        }
+
+        // Splits the stream into ordered parts, about four per worker
+        template<typename S>
+        std::vector<S> split_stream(S const &s, size_t workers, size_t grain)
+        {
+            size_t depth = 0;
+            while((size_t{ 1 } << depth) < workers * 4)
+                ++depth;
+
+            std::vector<S> parts;
+            split_parts(s, depth, parts, grain);
+            return parts;
+        }
+    }
+
+    // Reduces the parts of a split stream on the pool, then combines partial results in the stream order.
+    // Streams which can't be split are reduced on a single worker.
+    template<typename S, typename R, typename FnAcc, typename FnCombine>
+    R parallel_reduce(S const &s, R identity, FnAcc acc, FnCombine combine, thread_pool &pool = thread_pool::shared(), size_t grain = 1024)
+    {
+        std::vector<std::future<R>> results;
+        for(auto &part : internal::split_stream(s, pool.size(), grain))
+        {
+            results.push_back(pool.submit([part = std::move(part), identity, acc]()
+            {
+                trace::span span("parallel_reduce part", "batch");
+                R res = identity;
+                for(auto v = part.next(); v; v = part.next())
+                    res = acc(std::move(res), *v);
+                return res;
+            }));
+        }
+
+        R res = identity;
+        for(auto &r : results)
+            res = combine(std::move(res), r.get());
+        return res;
+    }
+
+    // Calls fn for every element. Elements of different parts are processed concurrently in no particular order.
+    template<typename S, typename Fn>
+    void parallel_for_each(S const &s, Fn fn, thread_pool &pool = thread_pool::shared(), size_t grain = 1024)
+    {
+        std::vector<std::future<void>> done;
+        for(auto &part : internal::split_stream(s, pool.size(), grain))
+        {
+            done.push_back(pool.submit([part = std::move(part), fn]()
+            {
+                trace::span span("parallel_for_each part", "batch");
+                for(auto v = part.next(); v; v = part.next())
+                    fn(*v);
+            }));
+        }
+
+        for(auto &d : done)
+            d.get();
+    }
+}
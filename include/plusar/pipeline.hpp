@@ -0,0 +1,687 @@
+#pragma once
+#include <plusar/any_stream.hpp>
+#include <stdexcept>
+#include <functional>
+#include <typeindex>
+#include <algorithm>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <limits>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <utility>
+#include <map>
+#include <any>
+
+// Pipelines assembled at run time from a JSON or INI description.
+//
+// JSON: an array of stages, or an object with a "stages" array. Every stage is an object of scalar values:
+//     { "stages": [ { "op": "filter", "cmp": "gt", "value": 10 }, { "op": "map", "fn": "mul", "value": 3 } ] }
+// INI: a section per stage, named after the operator:
+//     [filter]
+//     cmp = gt
+//     value = 10
+//
+// Operators are looked up by name and element type in an operator_registry. The whole chain is built, and so
+// type checked, when the pipeline is loaded; errors are reported as pipeline_error before any element is pulled.
+// Built-in operators of the int64, double and string element types pick a concrete stage for their parameters
+// at load time, so no parameter is interpreted per element.
+//
+// Overhead: every stage is an any_stream. Built-in stages exchange whole batches, so a stage costs one virtual call
+// per batch plus a pass over the batch, about 1-2 ns per element and stage. With per element work of a few
+// arithmetic operations, a configured chain takes 2-2.5x the time of the same chain written as templates
+// (pipeline/* benchmarks of plusar-bench); heavier per element work makes the difference proportionally smaller.
+namespace plusar
+{
+    class pipeline_error : public std::runtime_error
+    {
+    public:
+        explicit pipeline_error(std::string const &what):
+            std::runtime_error(what)
+        {}
+    };
+
+    // Operator name and parameters of a stage. Values are kept as text and converted on request.
+    struct stage_config
+    {
+        std::string                        op;
+        std::map<std::string, std::string> params;
+
+        bool has(std::string const &key) const
+        {
+            return params.count(key) != 0;
+        }
+
+        std::string const & get(std::string const &key) const
+        {
+            auto it = params.find(key);
+            if (it == params.end())
+                throw pipeline_error("stage '" + op + "': missing parameter '" + key + "'");
+            return it->second;
+        }
+
+        template<typename T>
+        T get(std::string const &key) const
+        {
+            std::istringstream is(get(key));
+            T value{};
+            if (!(is >> value) || !(is >> std::ws).eof())
+                throw pipeline_error("stage '" + op + "': invalid value of '" + key + "'");
+            return value;
+        }
+
+        template<typename T>
+        T get(std::string const &key, T const &default_value) const
+        {
+            return has(key) ? get<T>(key) : default_value;
+        }
+    };
+
+    // Stream of a type known at run time
+    class dynamic_stream
+    {
+        std::type_index _type;
+        std::any        _stream;
+
+    public:
+        template<typename T, size_t Capacity>
+        dynamic_stream(stream<internal::any_stream_fn<T, Capacity>> const &s):
+            _type(typeid(T)),
+            _stream(any_stream<T>(s))
+        {}
+
+        std::type_index type() const
+        {
+            return _type;
+        }
+
+        template<typename T>
+        bool is() const
+        {
+            return _type == typeid(T);
+        }
+
+        template<typename T>
+        any_stream<T> const & as() const
+        {
+            if (auto s = std::any_cast<any_stream<T>>(&_stream))
+                return *s;
+            throw pipeline_error("stream type mismatch");
+        }
+    };
+
+    class operator_registry
+    {
+    public:
+        using factory = std::function<dynamic_stream(dynamic_stream const &, stage_config const &)>;
+
+    private:
+        std::map<std::pair<std::string, std::type_index>, factory> _ops;
+        std::map<std::type_index, std::string>                     _types;
+
+    public:
+        // Registers the name of an element type used in error messages
+        template<typename T>
+        operator_registry & add_type(std::string name)
+        {
+            _types[typeid(T)] = std::move(name);
+            return *this;
+        }
+
+        // Registers an operator for elements of type In. fn receives the input stream and the stage configuration,
+        // and returns the output stream, either a dynamic_stream or a stream of any type.
+        template<typename In, typename FnFactory>
+        operator_registry & add(std::string const &name, FnFactory fn)
+        {
+            _ops[{ name, typeid(In) }] = [fn = std::move(fn)](dynamic_stream const &src, stage_config const &config) -> dynamic_stream
+            {
+                auto out = fn(src.as<In>(), config);
+                if constexpr (std::is_same<decltype(out), dynamic_stream>::value)
+                    return out;
+                else
+                    return make_any_stream<typename decltype(out)::type>(out);
+            };
+            return *this;
+        }
+
+        std::string type_name(std::type_index type) const
+        {
+            auto it = _types.find(type);
+            return it != _types.end() ? it->second : type.name();
+        }
+
+        // Chains the stages onto the source, checking that every stage accepts the elements of the previous one
+        dynamic_stream build(dynamic_stream src, std::vector<stage_config> const &stages) const
+        {
+            for(size_t i = 0; i < stages.size(); ++i)
+            {
+                auto const &config = stages[i];
+                auto it = _ops.find({ config.op, src.type() });
+                if (it == _ops.end())
+                {
+                    std::string accepted;
+                    for(auto const &op : _ops)
+                        if (op.first.first == config.op)
+                            accepted += (accepted.empty() ? "" : ", ") + type_name(op.first.second);
+
+                    throw pipeline_error("stage " + std::to_string(i + 1) + " '" + config.op + "': "
+                                         + (accepted.empty() ? "unknown operator"
+                                                             : "doesn't accept " + type_name(src.type()) + " elements (accepts " + accepted + ")"));
+                }
+                src = it->second(src, config);
+            }
+            return src;
+        }
+
+        // Built-in operators
+        static operator_registry const & standard();
+    };
+
+    namespace internal
+    {
+        // Minimal JSON reader for pipeline descriptions
+        class json_stages
+        {
+            std::string const &_text;
+            size_t _pos = 0;
+
+            [[noreturn]] void fail(std::string const &what) const
+            {
+                throw pipeline_error("JSON offset " + std::to_string(_pos) + ": " + what);
+            }
+
+            char peek()
+            {
+                while(_pos < _text.size() && std::isspace(static_cast<unsigned char>(_text[_pos])))
+                    ++_pos;
+                return _pos < _text.size() ? _text[_pos] : '\0';
+            }
+
+            void expect(char c)
+            {
+                if (peek() != c)
+                    fail(std::string("expected '") + c + "'");
+                ++_pos;
+            }
+
+            std::string string()
+            {
+                expect('"');
+                std::string s;
+                for(; _pos < _text.size() && _text[_pos] != '"'; ++_pos)
+                {
+                    char c = _text[_pos];
+                    if (c == '\\' && ++_pos < _text.size())
+                    {
+                        switch(c = _text[_pos])
+                        {
+                            case 'n':   c = '\n'; break;
+                            case 't':   c = '\t'; break;
+                            case 'r':   c = '\r'; break;
+                            case 'b':   c = '\b'; break;
+                            case 'f':   c = '\f'; break;
+                            case 'u':   fail("\\u escapes aren't supported");
+                            default:    break;
+                        }
+                    }
+                    s += c;
+                }
+                expect('"');
+                return s;
+            }
+
+            // Numbers, true, false and null as their text
+            std::string scalar()
+            {
+                if (peek() == '"')
+                    return string();
+                size_t const begin = _pos;
+                for(; _pos < _text.size(); ++_pos)
+                {
+                    char const c = _text[_pos];
+                    if (!std::isalnum(static_cast<unsigned char>(c)) && c != '+' && c != '-' && c != '.')
+                        break;
+                }
+                if (begin == _pos)
+                    fail("expected a value");
+                return _text.substr(begin, _pos - begin);
+            }
+
+            void skip_value()
+            {
+                char const c = peek();
+                if (c == '{' || c == '[')
+                {
+                    char const close = c == '{' ? '}' : ']';
+                    ++_pos;
+                    while(peek() != close)
+                    {
+                        if (c == '{')
+                        {
+                            string();
+                            expect(':');
+                        }
+                        skip_value();
+                        if (peek() == ',')
+                            ++_pos;
+                        else if (peek() != close)
+                            fail(std::string("expected '") + close + "'");
+                    }
+                    ++_pos;
+                }
+                else
+                    scalar();
+            }
+
+            stage_config stage()
+            {
+                stage_config config;
+                expect('{');
+                while(peek() != '}')
+                {
+                    auto key = string();
+                    expect(':');
+                    if (peek() == '{' || peek() == '[')
+                        fail("parameter '" + key + "' must be a scalar");
+                    auto value = scalar();
+                    if (key == "op")
+                        config.op = std::move(value);
+                    else
+                        config.params[std::move(key)] = std::move(value);
+                    if (peek() == ',')
+                        ++_pos;
+                    else if (peek() != '}')
+                        fail("expected '}'");
+                }
+                ++_pos;
+                if (config.op.empty())
+                    fail("stage without \"op\"");
+                return config;
+            }
+
+            std::vector<stage_config> stages()
+            {
+                std::vector<stage_config> result;
+                expect('[');
+                while(peek() != ']')
+                {
+                    result.push_back(stage());
+                    if (peek() == ',')
+                        ++_pos;
+                    else if (peek() != ']')
+                        fail("expected ']'");
+                }
+                ++_pos;
+                return result;
+            }
+
+            std::vector<stage_config> description()
+            {
+                if (peek() == '[')
+                    return stages();
+
+                std::optional<std::vector<stage_config>> result;
+                expect('{');
+                while(peek() != '}')
+                {
+                    if (string() == "stages")
+                    {
+                        expect(':');
+                        result = stages();
+                    }
+                    else
+                    {
+                        expect(':');
+                        skip_value();
+                    }
+                    if (peek() == ',')
+                        ++_pos;
+                    else if (peek() != '}')
+                        fail("expected '}'");
+                }
+                ++_pos;
+                if (!result)
+                    fail("no \"stages\" array");
+                return *result;
+            }
+
+        public:
+            explicit json_stages(std::string const &text):
+                _text(text)
+            {}
+
+            // The description must be the whole text
+            std::vector<stage_config> parse()
+            {
+                auto result = description();
+                peek();
+                if (_pos != _text.size())
+                    fail("unexpected text after the pipeline description");
+                return result;
+            }
+        };
+
+        inline std::string trim(std::string const &s)
+        {
+            size_t const begin = s.find_first_not_of(" \t\r");
+            size_t const end = s.find_last_not_of(" \t\r");
+            return begin == std::string::npos ? std::string() : s.substr(begin, end - begin + 1);
+        }
+
+        inline std::vector<stage_config> ini_stages(std::string const &text)
+        {
+            std::vector<stage_config> result;
+            std::istringstream is(text);
+            std::string line;
+            for(size_t n = 1; std::getline(is, line); ++n)
+            {
+                line = trim(line);
+                if (line.empty() || line[0] == '#' || line[0] == ';')
+                    continue;
+
+                if (line.front() == '[' && line.back() == ']')
+                    result.push_back(stage_config{ trim(line.substr(1, line.size() - 2)), {} });
+                else
+                {
+                    size_t const eq = line.find('=');
+                    if (eq == std::string::npos || result.empty())
+                        throw pipeline_error("INI line " + std::to_string(n) + ": expected [operator] or key = value");
+                    result.back().params[trim(line.substr(0, eq))] = trim(line.substr(eq + 1));
+                }
+            }
+            return result;
+        }
+
+        // Stages of the built-in operators work on whole batches of the erased input, so a configured chain
+        // runs batch by batch with one virtual call per batch and stage
+        template<typename T, typename FnPredicate>
+        struct batch_filter_fn
+        {
+            any_stream<T> src;
+            FnPredicate pred;
+
+            std::optional<T> operator()() const
+            {
+                for(auto v = src.next(); v; v = src.next())
+                    if (pred(*v))
+                        return v;
+                return std::nullopt;
+            }
+
+            size_t next_batch(T *out, size_t n) const
+            {
+                size_t k = 0;
+                while(k < n)
+                {
+                    size_t const count = src.next_batch(out + k, n - k);
+                    if (!count)
+                        break;
+                    size_t const end = k + count;
+                    for(size_t i = k; i < end; ++i)
+                    {
+                        if (pred(out[i]))
+                        {
+                            if (k != i)
+                                out[k] = std::move(out[i]);
+                            ++k;
+                        }
+                    }
+                }
+                return k;
+            }
+        };
+
+        template<typename T, typename R, typename FnR>
+        struct batch_map_fn
+        {
+            static constexpr size_t batch = std::max<size_t>(1, 256 / sizeof(T));
+
+            any_stream<T> src;
+            FnR fn;
+
+            std::optional<R> operator()() const
+            {
+                auto v = src.next();
+                return v ? std::make_optional<R>(fn(std::move(*v))) : std::nullopt;
+            }
+
+            size_t next_batch(R *out, size_t n) const
+            {
+                if constexpr (std::is_same<T, R>::value)
+                {
+                    size_t const count = src.next_batch(out, n);
+                    for(size_t i = 0; i < count; ++i)
+                        out[i] = fn(std::move(out[i]));
+                    return count;
+                }
+                else
+                {
+                    T in[batch];
+                    size_t k = 0;
+                    while(k < n)
+                    {
+                        size_t const count = src.next_batch(in, std::min(batch, n - k));
+                        for(size_t i = 0; i < count; ++i)
+                            out[k + i] = fn(std::move(in[i]));
+                        k += count;
+                        if (!count)
+                            break;
+                    }
+                    return k;
+                }
+            }
+        };
+
+        template<typename T, typename FnPredicate>
+        any_stream<T> batch_filter(any_stream<T> const &src, FnPredicate pred)
+        {
+            return make_any_stream<T>(make_stage("filter", batch_filter_fn<T, FnPredicate>{ src, std::move(pred) }));
+        }
+
+        template<typename T, typename FnR, typename R = std::decay_t<std::invoke_result_t<FnR const &, T>>>
+        any_stream<R> batch_map(any_stream<T> const &src, FnR fn)
+        {
+            return make_any_stream<R>(make_stage("map", batch_map_fn<T, R, FnR>{ src, std::move(fn) }));
+        }
+
+        template<typename T>
+        dynamic_stream typed_filter(any_stream<T> const &src, stage_config const &config)
+        {
+            auto const cmp = config.get("cmp");
+            auto const v = config.get<T>("value");
+
+            if (cmp == "lt") return batch_filter(src, [v](T const &e) { return e < v; });
+            if (cmp == "le") return batch_filter(src, [v](T const &e) { return e <= v; });
+            if (cmp == "gt") return batch_filter(src, [v](T const &e) { return e > v; });
+            if (cmp == "ge") return batch_filter(src, [v](T const &e) { return e >= v; });
+            if (cmp == "eq") return batch_filter(src, [v](T const &e) { return e == v; });
+            if (cmp == "ne") return batch_filter(src, [v](T const &e) { return e != v; });
+            throw pipeline_error("filter: unknown cmp '" + cmp + "'");
+        }
+
+        template<typename T>
+        dynamic_stream typed_map(any_stream<T> const &src, stage_config const &config)
+        {
+            auto const fn = config.get("fn");
+
+            if (fn == "neg") return batch_map(src, [](T e) { return static_cast<T>(-e); });
+            if (fn == "abs") return batch_map(src, [](T e) { return e < 0 ? static_cast<T>(-e) : e; });
+
+            auto const v = config.get<T>("value");
+            if (fn == "add") return batch_map(src, [v](T e) { return static_cast<T>(e + v); });
+            if (fn == "sub") return batch_map(src, [v](T e) { return static_cast<T>(e - v); });
+            if (fn == "mul") return batch_map(src, [v](T e) { return static_cast<T>(e * v); });
+            if (fn == "div")
+            {
+                if (v == T{})
+                    throw pipeline_error("map: division by zero");
+                return batch_map(src, [v](T e) { return static_cast<T>(e / v); });
+            }
+            throw pipeline_error("map: unknown fn '" + fn + "'");
+        }
+
+        // Aggregate of every 'window' consecutive elements, the last window may be partial.
+        // A zero window covers the whole stream.
+        template<typename T, typename R, typename Acc, typename Result>
+        any_stream<R> windowed(any_stream<T> const &src, size_t window, Acc acc, Result result)
+        {
+            if (!window)
+                window = SIZE_MAX;
+
+            return make_any_stream<R>(make_stream([src, window, acc, result]() -> std::optional<R>
+            {
+                auto v = src.next();
+                if (!v)
+                    return std::nullopt;
+
+                auto state = acc(std::nullopt, *v);
+                for(size_t n = 1; n < window && (v = src.next()); ++n)
+                    state = acc(state, *v);
+                return result(state);
+            }));
+        }
+
+        template<typename T>
+        dynamic_stream typed_aggregate(any_stream<T> const &src, stage_config const &config)
+        {
+            auto const fn = config.get("fn");
+            auto const window = config.get<size_t>("window", 0);
+
+            using pair = std::pair<double, size_t>;
+            auto const same = [](T v) { return v; };
+
+            if (fn == "sum")
+                return windowed<T, T>(src, window, [](std::optional<T> s, T v) { return static_cast<T>(s.value_or(T{}) + v); }, same);
+            if (fn == "min")
+                return windowed<T, T>(src, window, [](std::optional<T> s, T v) { return s && *s < v ? *s : v; }, same);
+            if (fn == "max")
+                return windowed<T, T>(src, window, [](std::optional<T> s, T v) { return s && v < *s ? *s : v; }, same);
+            if (fn == "count")
+                return windowed<T, int64_t>(src, window, [](std::optional<int64_t> s, T) { return s.value_or(0) + 1; }, [](int64_t n) { return n; });
+            if (fn == "mean")
+                return windowed<T, double>(src, window,
+                                           [](std::optional<pair> s, T v) { auto p = s.value_or(pair{ 0.0, 0 }); return pair{ p.first + v, p.second + 1 }; },
+                                           [](pair p) { return p.first / p.second; });
+            throw pipeline_error("aggregate: unknown fn '" + fn + "'");
+        }
+
+        template<typename T>
+        dynamic_stream typed_cast(any_stream<T> const &src, stage_config const &config)
+        {
+            auto const to = config.get("to");
+            if (to == "int64")
+                return batch_map(src, [](T v) { return static_cast<int64_t>(v); });
+            if (to == "double")
+                return batch_map(src, [](T v) { return static_cast<double>(v); });
+            if (to == "string")
+                return batch_map(src, [](T v) { std::ostringstream os; os << v; return os.str(); });
+            throw pipeline_error("cast: unknown type '" + to + "'");
+        }
+
+        inline dynamic_stream string_filter(any_stream<std::string> const &src, stage_config const &config)
+        {
+            auto const cmp = config.get("cmp");
+            auto const v = config.get("value");
+
+            if (cmp == "eq")        return batch_filter(src, [v](std::string const &e) { return e == v; });
+            if (cmp == "ne")        return batch_filter(src, [v](std::string const &e) { return e != v; });
+            if (cmp == "contains")  return batch_filter(src, [v](std::string const &e) { return e.find(v) != std::string::npos; });
+            if (cmp == "prefix")    return batch_filter(src, [v](std::string const &e) { return e.compare(0, v.size(), v) == 0; });
+            if (cmp == "suffix")    return batch_filter(src, [v](std::string const &e) { return e.size() >= v.size() && e.compare(e.size() - v.size(), v.size(), v) == 0; });
+            throw pipeline_error("filter: unknown cmp '" + cmp + "'");
+        }
+
+        inline dynamic_stream string_map(any_stream<std::string> const &src, stage_config const &config)
+        {
+            auto const fn = config.get("fn");
+
+            auto const convert = [](int (*f)(int))
+            {
+                return [f](std::string s)
+                {
+                    for(auto &c : s)
+                        c = static_cast<char>(f(static_cast<unsigned char>(c)));
+                    return s;
+                };
+            };
+
+            if (fn == "upper")  return batch_map(src, convert(&::toupper));
+            if (fn == "lower")  return batch_map(src, convert(&::tolower));
+            if (fn == "length") return batch_map(src, [](std::string const &s) { return static_cast<int64_t>(s.size()); });
+            throw pipeline_error("map: unknown fn '" + fn + "'");
+        }
+
+        // Operators of every element type
+        template<typename T>
+        void add_generic(operator_registry &r)
+        {
+            r.add<T>("take", [](any_stream<T> const &src, stage_config const &c) { return src.take(c.get<size_t>("n")); });
+            r.add<T>("skip", [](any_stream<T> const &src, stage_config const &c) { return src.skip(c.get<size_t>("n")); });
+            r.add<T>("slice", [](any_stream<T> const &src, stage_config const &c)
+            {
+                return src.slice(c.get<size_t>("start", 0), c.get<size_t>("end", SIZE_MAX), c.get<size_t>("step", 1));
+            });
+        }
+
+        template<typename T>
+        void add_numeric(operator_registry &r)
+        {
+            add_generic<T>(r);
+            r.add<T>("filter", &typed_filter<T>);
+            r.add<T>("map", &typed_map<T>);
+            r.add<T>("aggregate", &typed_aggregate<T>);
+            r.add<T>("cast", &typed_cast<T>);
+        }
+    }
+
+    inline operator_registry const & operator_registry::standard()
+    {
+        static operator_registry const registry = []()
+        {
+            operator_registry r;
+            r.add_type<int64_t>("int64")
+             .add_type<double>("double")
+             .add_type<std::string>("string");
+
+            internal::add_numeric<int64_t>(r);
+            internal::add_numeric<double>(r);
+
+            internal::add_generic<std::string>(r);
+            r.add<std::string>("filter", &internal::string_filter);
+            r.add<std::string>("map", &internal::string_map);
+            return r;
+        }();
+        return registry;
+    }
+
+    // Parses a pipeline description: JSON when it is an object or an array of objects, INI otherwise
+    inline std::vector<stage_config> parse_pipeline(std::string const &text)
+    {
+        size_t const first = text.find_first_not_of(" \t\r\n");
+        if (first == std::string::npos)
+            return {};
+
+        size_t const second = text.find_first_not_of(" \t\r\n", first + 1);
+        bool const json = text[first] == '{'
+                          || (text[first] == '[' && second != std::string::npos && (text[second] == '{' || text[second] == ']'));
+
+        return json ? internal::json_stages(text).parse() : internal::ini_stages(text);
+    }
+
+    // Builds the pipeline described by config over the source, which produces Out elements.
+    // Throws pipeline_error when the description is invalid or the stage types don't match.
+    template<typename Out, typename Fn>
+    any_stream<Out> make_pipeline(stream<Fn> const &source, std::string const &config,
+                                  operator_registry const &registry = operator_registry::standard())
+    {
+        using In = typename stream<Fn>::type;
+
+        dynamic_stream const out = registry.build(make_any_stream<In>(source), parse_pipeline(config));
+        if (!out.is<Out>())
+            throw pipeline_error("pipeline produces " + registry.type_name(out.type()) + " elements, " + registry.type_name(typeid(Out)) + " expected");
+        return out.as<Out>();
+    }
+}
@@ -0,0 +1,798 @@
+#pragma once
+#include <plusar/stream.hpp>
+#include <plusar/file.hpp>
+#include <plusar/merge.hpp>
+#include <plusar/parallel.hpp>
+#include <type_traits>
+#include <functional>
+#include <algorithm>
+#include <optional>
+#include <exception>
+#include <utility>
+#include <future>
+#include <memory>
+#include <vector>
+#include <array>
+#include <string>
+#include <limits>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+namespace plusar
+{
+    // Encoding of the elements of runs spilled by sort, for elements which aren't trivially copyable
+    // (those are written as their bytes). A specialization provides
+    //     static size_t size(T const &v)                                   bytes written for v
+    //     static char * write(T const &v, char *out)                       returns the end of the written bytes
+    //     static char const * read(char const *in, char const *end, T &v)  returns the end of the read bytes,
+    //                                                                      nullptr when [in, end) doesn't hold all of them
+    template<typename T, typename = void>
+    struct spill_serializer {};
+
+    namespace internal
+    {
+        // Length followed by the values of a contiguous sequence of trivially copyable values
+        template<typename Seq>
+        struct length_prefixed
+        {
+            using value_type = typename Seq::value_type;
+
+            static size_t size(Seq const &v)
+            {
+                return sizeof(uint64_t) + v.size() * sizeof(value_type);
+            }
+
+            static char * write(Seq const &v, char *out)
+            {
+                uint64_t const n = v.size();
+                std::memcpy(out, &n, sizeof(n));
+                if (n)
+                    std::memcpy(out + sizeof(n), v.data(), n * sizeof(value_type));
+                return out + size(v);
+            }
+
+            static char const * read(char const *in, char const *end, Seq &v)
+            {
+                uint64_t n;
+                size_t const available = static_cast<size_t>(end - in);
+                if (available < sizeof(n))
+                    return nullptr;
+                std::memcpy(&n, in, sizeof(n));
+                if ((available - sizeof(n)) / sizeof(value_type) < n)
+                    return nullptr;
+
+                v.resize(static_cast<size_t>(n));
+                if (n)
+                    std::memcpy(&v[0], in + sizeof(n), v.size() * sizeof(value_type));
+                return in + sizeof(n) + v.size() * sizeof(value_type);
+            }
+        };
+    }
+
+    template<typename C, typename Traits, typename A>
+    struct spill_serializer<std::basic_string<C, Traits, A>> : internal::length_prefixed<std::basic_string<C, Traits, A>> {};
+
+    template<typename T, typename A>
+    struct spill_serializer<std::vector<T, A>, std::enable_if_t<std::is_trivially_copyable<T>::value && !std::is_same<T, bool>::value>>
+        : internal::length_prefixed<std::vector<T, A>> {};
+}
+
+namespace plusar::internal
+{
+    template<typename T, typename = void>
+    struct has_spill_serializer : std::false_type {};
+
+    template<typename T>
+    struct has_spill_serializer<T, std::void_t<decltype(spill_serializer<T>::size(std::declval<T const &>()))>> : std::true_type {};
+
+    template<typename K>
+    struct is_radix_key : std::integral_constant<bool, std::is_integral<K>::value
+                                                       || std::is_same<K, float>::value
+                                                       || std::is_same<K, double>::value> {};
+
+    // Unsigned integer ordered as the key: the sign bit of integers is flipped, negative floats are inverted.
+    // -0.0 is mapped to 0.0, which compares equal to it, and every NaN to the same key after +infinity,
+    // so radix sorts keep the order of elements with such keys.
+    template<typename K>
+    constexpr auto radix_key(K k)
+    {
+        if constexpr (std::is_same<K, bool>::value)
+            return static_cast<uint8_t>(k);
+        else if constexpr (std::is_integral<K>::value)
+        {
+            using U = std::make_unsigned_t<K>;
+            if constexpr (std::is_signed<K>::value)
+                return static_cast<U>(static_cast<U>(k) ^ (U{ 1 } << (sizeof(U) * 8 - 1)));
+            else
+                return static_cast<U>(k);
+        }
+        else
+        {
+            using U = std::conditional_t<sizeof(K) == 4, uint32_t, uint64_t>;
+            if (k == 0)
+                k = 0;
+            else if (k != k)
+                k = std::fabs(std::numeric_limits<K>::quiet_NaN());
+
+            U u;
+            std::memcpy(&u, &k, sizeof(u));
+            U const sign = U{ 1 } << (sizeof(U) * 8 - 1);
+            return static_cast<U>(u & sign ? ~u : u | sign);
+        }
+    }
+
+    // Stable LSD radix sort of [first, last) by key(element), a byte per pass. scratch holds last - first elements.
+    // All digits are counted in one pass over the input, passes where every key has the same digit are skipped.
+    template<typename T, typename Key>
+    void radix_sort(T *first, T *last, T *scratch, Key const &key)
+    {
+        using U = decltype(radix_key(key(*first)));
+        constexpr size_t passes = sizeof(U);
+
+        size_t const n = static_cast<size_t>(last - first);
+        if (n < 2)
+            return;
+
+        std::array<std::array<size_t, 256>, passes> counts{};
+        for(size_t i = 0; i < n; ++i)
+        {
+            U const k = radix_key(key(first[i]));
+            for(size_t p = 0; p < passes; ++p)
+                ++counts[p][(k >> (p * 8)) & 0xff];
+        }
+
+        T *src = first, *dst = scratch;
+        for(size_t p = 0; p < passes; ++p)
+        {
+            auto &c = counts[p];
+            if (std::find(c.begin(), c.end(), n) != c.end())
+                continue;
+
+            size_t sum = 0;
+            for(auto &v : c)
+            {
+                size_t const count = v;
+                v = sum;
+                sum += count;
+            }
+
+            for(size_t i = 0; i < n; ++i)
+                dst[c[(radix_key(key(src[i])) >> (p * 8)) & 0xff]++] = std::move(src[i]);
+            std::swap(src, dst);
+        }
+
+        if (src != first)
+            std::move(src, src + n, first);
+    }
+
+    template<typename Cmp, typename T>
+    struct is_ascending : std::false_type {};
+
+    template<typename T>
+    struct is_ascending<std::less<>, T> : std::true_type {};
+
+    template<typename T>
+    struct is_ascending<std::less<T>, T> : std::true_type {};
+
+    // Radix sort for arithmetic elements in ascending order, std::sort otherwise
+    template<typename T, typename Cmp>
+    void sort_run(std::vector<T> &run, std::vector<T> &scratch, Cmp const &cmp)
+    {
+        if constexpr (is_ascending<Cmp, T>::value && is_radix_key<T>::value)
+        {
+            if (run.size() >= 256)
+            {
+                scratch.resize(run.size());
+                radix_sort(run.data(), run.data() + run.size(), scratch.data(), identity_key());
+                return;
+            }
+        }
+        std::sort(run.begin(), run.end(), cmp);
+    }
+
+#ifdef PLUSAR_HAS_MMAP
+    // Sorted run stored in the spill file, or kept in memory. The next block is read, and decoded when the elements
+    // are encoded, by the I/O thread while the current one is consumed.
+    template<typename T>
+    class run_cursor
+    {
+        std::shared_ptr<spill_file const> _file;
+        thread_pool                      *_io;
+        size_t                            _offset;         // of the first byte not requested yet
+        size_t                            _unread;         // bytes not requested yet
+        size_t                            _block;          // bytes, a multiple of sizeof(T) for raw elements
+        size_t                            _left;           // elements not consumed yet
+        std::vector<T>                    _current;
+        std::vector<T>                    _next;
+        std::vector<char>                 _partial;        // bytes of an encoded element split between blocks
+        size_t                            _pos = 0;
+        std::future<void>                 _pending;        // fills _next
+
+        run_cursor(run_cursor const &) = delete;
+        run_cursor & operator = (run_cursor const &) = delete;
+
+        // Reads blocks until an element is complete
+        void decode()
+        {
+            _next.clear();
+            while(_next.empty() && _unread)
+            {
+                size_t const n = std::min(_block, _unread);
+                size_t const kept = _partial.size();
+                _partial.resize(kept + n);
+                _file->read(_offset, _partial.data() + kept, n);
+                _offset += n;
+                _unread -= n;
+
+                char const *in = _partial.data(), *end = in + _partial.size();
+                for(;;)
+                {
+                    T v;
+                    auto const *next = spill_serializer<T>::read(in, end, v);
+                    if (!next)
+                        break;
+                    _next.push_back(std::move(v));
+                    in = next;
+                }
+                _partial.erase(_partial.begin(), _partial.begin() + (in - _partial.data()));
+            }
+        }
+
+        void prefetch()
+        {
+            if (!_unread)
+                return;
+
+            if constexpr (std::is_trivially_copyable<T>::value)
+            {
+                size_t const n = std::min(_block, _unread);
+                size_t const offset = _offset;
+                _next.resize(n / sizeof(T));
+                _offset += n;
+                _unread -= n;
+                _pending = _io->submit([this, offset, n]() { _file->read(offset, _next.data(), n); });
+            }
+            else
+                _pending = _io->submit([this]() { decode(); });
+        }
+
+    public:
+        run_cursor(std::shared_ptr<spill_file const> file, thread_pool &io, size_t offset, size_t bytes, size_t size, size_t block):
+            _file(std::move(file)),
+            _io(&io),
+            _offset(offset),
+            _unread(bytes),
+            _block(std::max<size_t>(block, 1)),
+            _left(size)
+        {
+            prefetch();
+        }
+
+        explicit run_cursor(std::vector<T> &&run):
+            _io(nullptr),
+            _offset(0),
+            _unread(0),
+            _block(0),
+            _left(run.size()),
+            _current(std::move(run))
+        {}
+
+        ~run_cursor()
+        {
+            if (_pending.valid())
+                _pending.wait();
+        }
+
+        size_t left() const
+        {
+            return _left;
+        }
+
+        size_t next_batch(T *out, size_t count)
+        {
+            if (_pos == _current.size())
+            {
+                if (!_pending.valid())
+                    return 0;
+                _pending.get();
+                std::swap(_current, _next);
+                _pos = 0;
+                prefetch();
+            }
+
+            size_t const n = std::min(count, _current.size() - _pos);
+            std::move(_current.begin() + _pos, _current.begin() + _pos + n, out);
+            _pos += n;
+            _left -= n;
+            return n;
+        }
+    };
+
+    // Input of the final merge. Copies share the cursor.
+    template<typename T>
+    struct run_reader_fn
+    {
+        std::shared_ptr<run_cursor<T>> cursor;
+
+        std::optional<T> operator()() const
+        {
+            T v;
+            return next_batch(&v, 1) ? std::make_optional(std::move(v)) : std::nullopt;
+        }
+
+        size_t next_batch(T *out, size_t count) const
+        {
+            return cursor->next_batch(out, count);
+        }
+
+        std::optional<size_t> size_hint() const
+        {
+            return cursor->left();
+        }
+    };
+#endif
+
+    template<typename Src, typename Cmp>
+    struct sort_fn
+    {
+        using type = typename Src::type;
+
+        // Runs hold the bytes of trivially copyable elements, or their encoding by spill_serializer
+        static constexpr bool raw = std::is_trivially_copyable<type>::value && std::is_default_constructible<type>::value;
+        static constexpr bool encoded = !std::is_trivially_copyable<type>::value && has_spill_serializer<type>::value
+                                        && std::is_default_constructible<type>::value;
+
+        static constexpr bool spillable =
+#ifdef PLUSAR_HAS_MMAP
+            raw || encoded;
+#else
+            false;
+#endif
+
+        struct state
+        {
+            std::vector<type>  memory;          // the whole input sorted, when it fitted in one run
+            size_t             pos = 0;
+            std::exception_ptr error;           // of sorting the input, rethrown by every pull
+#ifdef PLUSAR_HAS_MMAP
+            using reader = stream<run_reader_fn<type>>;
+            std::optional<stream<merge_fn<type, Cmp, std::vector<reader>, dynamic_inputs>>> merged;
+            std::unique_ptr<thread_pool> io;    // started with the first spilled run. The last member,
+                                                // so reads in flight finish first.
+#endif
+        };
+
+        Src src;
+        Cmp cmp;
+        size_t memory_budget;
+        mutable std::shared_ptr<state> st;
+
+        sort_fn(Src const &src, Cmp cmp, size_t memory_budget):
+            src(src),
+            cmp(std::move(cmp)),
+            memory_budget(memory_budget)
+        {}
+
+        sort_fn(sort_fn const &other):
+            src(other.src),
+            cmp(other.cmp),
+            memory_budget(other.memory_budget)
+        {}
+
+        // Size of a run: the run being read, the run being written and the radix sort scratch share the budget.
+        // Elements for raw runs, bytes of the elements and their encoding otherwise.
+        size_t run_limit() const
+        {
+            if (!spillable || memory_budget == SIZE_MAX)
+                return SIZE_MAX;
+            if constexpr (raw)
+                return std::max<size_t>(memory_budget / 3 / sizeof(type), 1024);
+            else
+                return std::max<size_t>(memory_budget / 3, 1);
+        }
+
+        // Reads more elements into run, up to the limit. Returns false once the source is exhausted.
+        bool fill(std::vector<type> &run, size_t limit) const
+        {
+            if constexpr (encoded)
+            {
+                for(size_t bytes = 0; bytes < limit; )
+                {
+                    auto v = src.next();
+                    if (!v)
+                        return false;
+                    bytes += sizeof(type) + spill_serializer<type>::size(*v);
+                    run.push_back(std::move(*v));
+                }
+                return true;
+            }
+            else if constexpr (std::is_default_constructible<type>::value)
+            {
+                constexpr size_t step = 4096;
+                while(run.size() < limit)
+                {
+                    size_t const old = run.size();
+                    size_t const k = std::min(step, limit - old);
+                    run.resize(old + k);
+                    size_t const n = src.next_batch(run.data() + old, k);
+                    run.resize(old + n);
+                    if (n < k)
+                        return false;
+                }
+                return true;
+            }
+            else
+            {
+                while(run.size() < limit)
+                {
+                    auto v = src.next();
+                    if (!v)
+                        return false;
+                    run.push_back(std::move(*v));
+                }
+                return true;
+            }
+        }
+
+        // Appends a run to the file. Returns the number of bytes written.
+        static size_t write(spill_file &file, std::vector<type> const &run, std::vector<char> &buffer)
+        {
+            if constexpr (raw)
+            {
+                file.append(run.data(), run.size() * sizeof(type));
+                return run.size() * sizeof(type);
+            }
+            else
+            {
+                size_t bytes = 0;
+                for(auto const &v : run)
+                    bytes += spill_serializer<type>::size(v);
+                buffer.resize(bytes);
+
+                char *out = buffer.data();
+                for(auto const &v : run)
+                    out = spill_serializer<type>::write(v, out);
+                file.append(buffer.data(), bytes);
+                return bytes;
+            }
+        }
+
+        // Sorts the input on the first pull. A failure is kept and rethrown by the following pulls,
+        // as the elements read before it are lost.
+        state & started() const
+        {
+            if (!st)
+            {
+                st = std::make_shared<state>();
+                try
+                {
+                    sort_input();
+                }
+                catch(...)
+                {
+                    st->error = std::current_exception();
+                    throw;
+                }
+            }
+            else if (st->error)
+                std::rethrow_exception(st->error);
+            return *st;
+        }
+
+        // Sorts runs while the previous run is written by the I/O thread
+        void sort_input() const
+        {
+            size_t const limit = run_limit();
+
+            std::vector<type> run, scratch;
+            bool more = fill(run, limit);
+            sort_run(run, scratch, cmp);
+            if (!more)
+            {
+                st->memory = std::move(run);
+                return;
+            }
+
+#ifdef PLUSAR_HAS_MMAP
+            if constexpr (spillable)
+            {
+                struct spilled
+                {
+                    size_t offset;
+                    size_t bytes;
+                    size_t size;
+                };
+
+                auto file = std::make_shared<spill_file>("sort");
+                st->io = std::make_unique<thread_pool>(1);
+                std::vector<spilled> runs;
+                std::vector<type> writing;
+                std::vector<char> buffer;              // encoding of the run being written
+                std::future<void> written;
+
+                try
+                {
+                    while(more)
+                    {
+                        if (written.valid())
+                            written.get();
+                        std::swap(run, writing);
+                        runs.push_back(spilled{ file->size(), 0, writing.size() });
+                        written = st->io->submit([&file, &writing, &buffer, &bytes = runs.back().bytes]() { bytes = write(*file, writing, buffer); });
+
+                        run.clear();
+                        more = fill(run, limit);
+                        sort_run(run, scratch, cmp);
+                    }
+                    written.get();
+                }
+                catch(...)
+                {
+                    // The write in flight refers to the buffers of this frame
+                    if (written.valid())
+                        written.wait();
+                    throw;
+                }
+                std::vector<type>().swap(writing);
+                std::vector<type>().swap(scratch);
+                std::vector<char>().swap(buffer);
+
+                // Two blocks per spilled run in flight, within the budget left by the last run kept in memory
+                size_t const block = raw ? std::clamp<size_t>(memory_budget / 3 / sizeof(type) / (2 * runs.size()), 1024, 1 << 16) * sizeof(type)
+                                         : std::clamp<size_t>(memory_budget / 3 / (2 * runs.size()), 1 << 12, 1 << 20);
+
+                std::vector<typename state::reader> readers;
+                for(auto const &r : runs)
+                    readers.emplace_back(run_reader_fn<type>{ std::make_shared<run_cursor<type>>(file, *st->io, r.offset, r.bytes, r.size, block) });
+                if (!run.empty())
+                    readers.emplace_back(run_reader_fn<type>{ std::make_shared<run_cursor<type>>(std::move(run)) });
+                st->merged.emplace(merge_fn<type, Cmp, std::vector<typename state::reader>, dynamic_inputs>(std::move(readers), cmp));
+            }
+#endif
+        }
+
+        std::optional<type> operator()() const
+        {
+            auto &s = started();
+#ifdef PLUSAR_HAS_MMAP
+            if constexpr (spillable)
+            {
+                if (s.merged)
+                    return s.merged->next();
+            }
+#endif
+            if (s.pos == s.memory.size())
+                return std::nullopt;
+            return std::move(s.memory[s.pos++]);
+        }
+
+        size_t next_batch(type *out, size_t count) const
+        {
+            auto &s = started();
+#ifdef PLUSAR_HAS_MMAP
+            if constexpr (spillable)
+            {
+                if (s.merged)
+                    return s.merged->next_batch(out, count);
+            }
+#endif
+            size_t const n = std::min(count, s.memory.size() - s.pos);
+            std::move(s.memory.begin() + s.pos, s.memory.begin() + s.pos + n, out);
+            s.pos += n;
+            return n;
+        }
+
+        std::optional<size_t> size_hint() const
+        {
+            if (!st)
+                return src.size_hint();
+            if (st->error)
+                return std::nullopt;
+#ifdef PLUSAR_HAS_MMAP
+            if constexpr (spillable)
+            {
+                if (st->merged)
+                    return st->merged->size_hint();
+            }
+#endif
+            return st->memory.size() - st->pos;
+        }
+    };
+
+    // Smallest part sorted by a worker
+    constexpr size_t sort_grain = 1 << 14;
+
+    // Calls fn(i) for the parts [0, parts) on the pool. Every part finishes before an exception is rethrown,
+    // as the parts refer to the caller's buffers.
+    template<typename Fn>
+    void for_parts(thread_pool &pool, size_t parts, Fn const &fn)
+    {
+        std::vector<std::future<void>> done;
+        done.reserve(parts);
+        for(size_t i = 0; i < parts; ++i)
+            done.push_back(pool.submit([&fn, i]() { fn(i); }));
+        for(auto &d : done)
+            d.wait();
+        for(auto &d : done)
+            d.get();
+    }
+
+    // radix_sort with every pass split between the workers: each one counts the digits of its part,
+    // then moves its part to the offsets following the parts before it.
+    template<typename T, typename Key>
+    void parallel_radix_sort(T *first, T *last, T *scratch, Key const &key, thread_pool &pool)
+    {
+        using U = decltype(radix_key(key(*first)));
+        constexpr size_t passes = sizeof(U);
+
+        size_t const n = static_cast<size_t>(last - first);
+        size_t const parts = std::min(pool.size(), n / sort_grain);
+        if (parts < 2)
+        {
+            radix_sort(first, last, scratch, key);
+            return;
+        }
+
+        auto const begin = [n, parts](size_t i) { return n * i / parts; };
+        std::vector<std::array<size_t, 256>> counts(parts);
+
+        T *src = first, *dst = scratch;
+        for(size_t p = 0; p < passes; ++p)
+        {
+            size_t const shift = p * 8;
+            for_parts(pool, parts, [&](size_t i)
+            {
+                auto &c = counts[i];
+                c.fill(0);
+                for(size_t j = begin(i); j < begin(i + 1); ++j)
+                    ++c[(radix_key(key(src[j])) >> shift) & 0xff];
+            });
+
+            bool trivial = false;
+            size_t sum = 0;
+            for(size_t d = 0; d < 256; ++d)
+            {
+                size_t const first_offset = sum;
+                for(auto &c : counts)
+                {
+                    size_t const count = c[d];
+                    c[d] = sum;
+                    sum += count;
+                }
+                trivial |= sum - first_offset == n;
+            }
+            if (trivial)
+                continue;
+
+            for_parts(pool, parts, [&](size_t i)
+            {
+                auto &c = counts[i];
+                for(size_t j = begin(i); j < begin(i + 1); ++j)
+                    dst[c[(radix_key(key(src[j])) >> shift) & 0xff]++] = std::move(src[j]);
+            });
+            std::swap(src, dst);
+        }
+
+        if (src != first)
+            for_parts(pool, parts, [&](size_t i) { std::move(src + begin(i), src + begin(i + 1), first + begin(i)); });
+    }
+
+    // Number of elements of a among the first d elements of the stable merge of a and b
+    template<typename T, typename Less>
+    size_t merge_split(T const *a, size_t na, T const *b, size_t nb, size_t d, Less const &less)
+    {
+        size_t lo = d > nb ? d - nb : 0;
+        size_t hi = std::min(d, na);
+        while(lo < hi)
+        {
+            size_t const mid = lo + (hi - lo) / 2;
+            if (less(b[d - mid - 1], a[mid]))
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+        return lo;
+    }
+
+    // Parts are sorted by the workers, then merged pairwise. Every merge is split into pieces of equal output size,
+    // so all workers take part in the last merges too.
+    template<typename T, typename Less>
+    void parallel_merge_sort(T *first, T *last, T *scratch, Less const &less, bool stable, thread_pool &pool)
+    {
+        auto const sort = [&less, stable](T *from, T *to)
+        {
+            if (stable)
+                std::stable_sort(from, to, less);
+            else
+                std::sort(from, to, less);
+        };
+
+        size_t const n = static_cast<size_t>(last - first);
+        size_t const parts = std::min(pool.size(), n / sort_grain);
+        if (parts < 2)
+        {
+            sort(first, last);
+            return;
+        }
+
+        std::vector<size_t> bounds(parts + 1);
+        for(size_t i = 0; i <= parts; ++i)
+            bounds[i] = n * i / parts;
+        for_parts(pool, parts, [&](size_t i) { sort(first + bounds[i], first + bounds[i + 1]); });
+
+        T *src = first, *dst = scratch;
+        while(bounds.size() > 2)
+        {
+            size_t const runs = bounds.size() - 1;
+            size_t const pieces = std::max<size_t>(parts / (runs / 2), 1);
+
+            // Piece k of the merge of runs 2m and 2m + 1 is the task m * pieces + k, an odd last run is moved as is
+            for_parts(pool, (runs + 1) / 2 * pieces, [&](size_t task)
+            {
+                size_t const m = task / pieces, k = task % pieces;
+                size_t const lo = bounds[2 * m], mid = bounds[std::min(2 * m + 1, runs)], hi = bounds[std::min(2 * m + 2, runs)];
+                size_t const total = hi - lo;
+                size_t const from = total * k / pieces, to = total * (k + 1) / pieces;
+
+                T *a = src + lo, *b = src + mid;
+                size_t const na = mid - lo, nb = hi - mid;
+                size_t const a_from = merge_split(a, na, b, nb, from, less), a_to = merge_split(a, na, b, nb, to, less);
+                std::merge(std::make_move_iterator(a + a_from), std::make_move_iterator(a + a_to),
+                           std::make_move_iterator(b + (from - a_from)), std::make_move_iterator(b + (to - a_to)),
+                           dst + lo + from, less);
+            });
+
+            std::vector<size_t> merged;
+            for(size_t i = 0; i < bounds.size(); i += 2)
+                merged.push_back(bounds[i]);
+            if (merged.back() != n)
+                merged.push_back(n);
+            bounds = std::move(merged);
+            std::swap(src, dst);
+        }
+
+        if (src != first)
+            for_parts(pool, parts, [&](size_t i) { std::move(src + n * i / parts, src + n * (i + 1) / parts, first + n * i / parts); });
+    }
+
+    // Sorts a vector by key(element) for stream::sorted
+    template<typename T, typename Key>
+    struct key_sort
+    {
+        using key_type = std::decay_t<std::invoke_result_t<Key const &, T const &>>;
+
+        Key key;
+        bool stable;
+
+        bool less(T const &a, T const &b) const
+        {
+            return key(a) < key(b);
+        }
+
+        void operator()(std::vector<T> &v, thread_pool *pool) const
+        {
+            auto const less = [this](T const &a, T const &b) { return this->less(a, b); };
+            if constexpr (std::is_default_constructible<T>::value)
+            {
+                if (v.size() >= 256)
+                {
+                    thread_pool &workers = pool ? *pool : thread_pool::shared();
+                    std::vector<T> scratch(v.size());
+                    if constexpr (is_radix_key<key_type>::value)
+                        parallel_radix_sort(v.data(), v.data() + v.size(), scratch.data(), key, workers);
+                    else
+                        parallel_merge_sort(v.data(), v.data() + v.size(), scratch.data(), less, stable, workers);
+                    return;
+                }
+            }
+
+            // Radix sort is stable, so is the sort of short vectors by radix keys
+            if (stable || is_radix_key<key_type>::value)
+                std::stable_sort(v.begin(), v.end(), less);
+            else
+                std::sort(v.begin(), v.end(), less);
+        }
+    };
+}
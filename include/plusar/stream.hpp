@@ -2,10 +2,129 @@
 #include <type_traits>
 #include <optional>
 #include <cstddef>
+#include <cstdint>
 #include <utility>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <functional>
+#include <tuple>
+#include <memory>
+#include <memory_resource>
+#include <iterator>
+#include <chrono>
+#include <vector>
+
+#ifdef PLUSAR_INSTRUMENT
+#   include <plusar/instrument.hpp>
+#endif
 
 namespace plusar
 {
+    // Defined in plusar/histogram.hpp
+    template<unsigned SubBucketBits>
+    class basic_histogram;
+
+    // Nanosecond latencies with 1% precision
+    using latency_histogram = basic_histogram<8>;
+
+    // Defined in plusar/cache.hpp
+    template<typename Src>
+    class cached;
+
+    // Defined in plusar/parallel.hpp
+    class thread_pool;
+
+    // Elements of a chunk placed contiguously in a buffer of the chunk stage.
+    // Valid until the next chunk is pulled, elements may be modified or moved out.
+    template<typename T>
+    class chunk_view
+    {
+        T      *_data;
+        size_t  _size;
+
+    public:
+        constexpr chunk_view(T *data, size_t size):
+            _data(data),
+            _size(size)
+        {}
+
+        constexpr T * data() const { return _data; }
+        constexpr size_t size() const { return _size; }
+        constexpr bool empty() const { return !_size; }
+        constexpr T * begin() const { return _data; }
+        constexpr T * end() const { return _data + _size; }
+        constexpr T & operator[](size_t i) const { return _data[i]; }
+    };
+
+    // Outcome of a pull bounded by a deadline
+    enum class pull_status
+    {
+        ready,
+        timeout,
+        end
+    };
+
+    namespace internal
+    {
+        template<typename Fn, typename = void>
+        struct has_advance : std::false_type {};
+
+        template<typename Fn>
+        struct has_advance<Fn, std::void_t<decltype(std::declval<Fn const &>().advance(size_t{}))>> : std::true_type {};
+
+        template<typename Fn, typename = void>
+        struct has_size_hint : std::false_type {};
+
+        template<typename Fn>
+        struct has_size_hint<Fn, std::void_t<decltype(std::declval<Fn const &>().size_hint())>> : std::true_type {};
+
+        template<typename Fn, typename = void>
+        struct has_at : std::false_type {};
+
+        template<typename Fn>
+        struct has_at<Fn, std::void_t<decltype(std::declval<Fn const &>().at(size_t{}))>> : std::true_type {};
+
+        template<typename Fn, typename T, typename = void>
+        struct has_next_batch : std::false_type {};
+
+        template<typename Fn, typename T>
+        struct has_next_batch<Fn, T, std::void_t<decltype(std::declval<Fn const &>().next_batch(std::declval<T *>(), size_t{}))>> : std::true_type {};
+
+        template<typename Fn, typename = void>
+        struct has_try_split : std::false_type {};
+
+        template<typename Fn>
+        struct has_try_split<Fn, std::void_t<decltype(std::declval<Fn const &>().try_split())>> : std::true_type {};
+
+        template<typename Fn, typename = void>
+        struct has_estimated_size : std::false_type {};
+
+        template<typename Fn>
+        struct has_estimated_size<Fn, std::void_t<decltype(std::declval<Fn const &>().estimated_size())>> : std::true_type {};
+
+        template<typename Agg, typename T, typename = void>
+        struct has_bind : std::false_type {};
+
+        template<typename Agg, typename T>
+        struct has_bind<Agg, T, std::void_t<decltype(std::declval<Agg const &>().template bind<T>())>> : std::true_type {};
+
+        template<typename Fn, typename T, typename = void>
+        struct has_next_until : std::false_type {};
+
+        template<typename Fn, typename T>
+        struct has_next_until<Fn, T, std::void_t<decltype(std::declval<Fn const &>().next_until(std::declval<std::optional<T> &>(), std::chrono::steady_clock::time_point{}))>> : std::true_type {};
+
+        struct identity_key
+        {
+            template<typename T>
+            constexpr T const & operator()(T const &v) const
+            {
+                return v;
+            }
+        };
+    }
+
     template<typename Fn>
     class stream
     {
@@ -23,8 +142,7 @@ namespace plusar
             _fn(other._fn)
         {}
 
-        stream(stream &&other) noexcept(std::is_nothrow_move_constructible<Fn>::value
-                                        &&std::is_nothrow_copy_constructible<Fn>::value):
+        stream(stream &&other) noexcept(std::is_nothrow_move_constructible<Fn>::value):
             _fn(std::forward<Fn>(other._fn))
         {}
 
@@ -54,6 +172,11 @@ namespace plusar
 
         constexpr auto flatten() const;
 
+        // Concatenates the sequences fn produces from the elements. fn returns an inner stream or, when R is given,
+        // receives the element and a std::vector<R> to append to, which is reused for every element.
+        template<typename R = void, typename FnR>
+        constexpr auto flat_map(FnR && fn) const;
+
         constexpr auto take(size_t limit) const;
 
         constexpr auto skip(size_t limit) const;
@@ -65,9 +188,154 @@ namespace plusar
 
         constexpr auto slice_to_end(size_t start, size_t step = 1) const;
 
+        // Groups the elements by n, the last chunk holds the rest. chunk yields views of a buffer reused for every chunk,
+        // chunk_vector yields vectors owning the elements.
+        constexpr auto chunk(size_t n) const;
+
+        constexpr auto chunk_vector(size_t n) const;
+
+        // Groups up to max_size elements into vectors. A group is emitted once it is full or max_delay has passed
+        // since its first element was pulled. The deadline fires while the source is idle only if the source waits
+        // with a deadline (see next_until), other sources are checked against the deadline after every element.
+        constexpr auto batch(size_t max_size, std::chrono::nanoseconds max_delay) const;
+
+        // Evaluates fn on a pool of workers keeping at most window elements in flight.
+        // Results are emitted in the source order. Requires plusar/parallel.hpp.
+        template<typename FnR>
+        constexpr auto parallel_map(FnR && fn, size_t workers = 0, size_t window = 0) const;
+
+        // As parallel_map, but results are emitted as soon as they are ready
+        template<typename FnR>
+        constexpr auto parallel_map_unordered(FnR && fn, size_t workers = 0, size_t window = 0) const;
+
+        // Keeps up to max_in_flight asynchronous operations outstanding. fn returns a std::future of the result,
+        // or, when R is given, receives the element and a completion<R> callback. Results keep the source order.
+        // Operations not completed within the timeout (zero means no timeout) make next() throw async_timeout.
+        // Returned futures are expected to become ready eventually, as those of std::async do: the ones dropped
+        // unfinished are kept by a helper thread until then. Requires plusar/async.hpp.
+        template<typename R = void, typename FnR>
+        constexpr auto async_map(FnR && fn, size_t max_in_flight, std::chrono::nanoseconds timeout = std::chrono::nanoseconds::zero()) const;
+
+        // As async_map, but results are emitted as soon as they are ready
+        template<typename R = void, typename FnR>
+        constexpr auto async_map_unordered(FnR && fn, size_t max_in_flight, std::chrono::nanoseconds timeout = std::chrono::nanoseconds::zero()) const;
+
+        // Evaluates this stream once for n branches, each producing all of its elements. Elements are kept in shared
+        // chunks of chunk_size elements, which are released once the slowest branch has passed them. A copy of a branch
+        // is one more branch starting at the same position. Branches may be pulled from different threads.
+        // Chunks are allocated from the resource, which must be thread safe when branches are released on different threads.
+        // Requires plusar/tee.hpp.
+        constexpr auto tee(size_t n, size_t chunk_size = 256, std::pmr::memory_resource *resource = std::pmr::get_default_resource()) const;
+
+        // Stores the elements as they are first produced, so passes over cached<stream>::replay() don't evaluate
+        // this stream again. Chunks beyond memory_limit bytes are kept in a mapped temporary file when the elements
+        // are trivially copyable. Chunks held in memory are allocated from the resource. Requires plusar/cache.hpp.
+        constexpr auto cache(size_t memory_limit = SIZE_MAX, std::pmr::memory_resource *resource = std::pmr::get_default_resource()) const;
+
+        // Elements sorted by cmp. Runs of about a third of memory_budget bytes are sorted in memory (radix sort for
+        // arithmetic elements compared by std::less, std::sort otherwise) and spilled to an unlinked file in $TMPDIR
+        // while the next run is read. The runs are merged as the output is pulled, reading ahead of the merge.
+        // Spilled elements are written as their bytes when they're trivially copyable, or by plusar::spill_serializer
+        // (strings and vectors of trivially copyable values). A budget for other elements doesn't compile.
+        // Requires plusar/sort.hpp.
+        template<typename Compare = std::less<>>
+        constexpr auto sort(Compare cmp = Compare{}) const;
+
+        template<typename Compare>
+        constexpr auto sort(Compare cmp, size_t memory_budget) const;
+
+        // Collects the elements sorted by key(element) in ascending order, using the workers of the pool
+        // (thread_pool::shared() when it's null). Integral and floating point keys are radix sorted, which keeps
+        // the order of equal keys (-0.0 equals 0.0, NaN keys come last). Other keys are merge sorted, and the order
+        // of equal keys is kept only when stable is set. Requires plusar/sort.hpp.
+        template<typename Key = internal::identity_key>
+        std::vector<type> sorted(Key key = Key{}, bool stable = false, thread_pool *pool = nullptr) const;
+
+        // Latency measurement between a pair of stages. Each element emitted by record_latency adds to the histogram
+        // the time passed since mark_ingest produced the oldest element not accounted yet. So filtered out elements
+        // count towards the next emitted one, and reductions report their oldest input. The ingest time is kept by
+        // the record_latency stage, so pipelines don't affect each other. Both stages must be pulled on the same thread.
+        // Requires plusar/histogram.hpp.
+        constexpr auto mark_ingest() const;
+
+        constexpr auto record_latency(latency_histogram &histogram) const;
+
+        // Skips up to n elements without producing them. Returns the number of skipped elements.
+        constexpr size_t advance(size_t n) const;
+
+        // Exact number of remaining elements: SIZE_MAX for endless streams, nullopt when it's unknown.
+        constexpr std::optional<size_t> size_hint() const;
+
+        // Element placed i positions after the current one. Nothing is consumed.
+        // Available for random access streams only.
+        template<typename F = Fn, typename = std::enable_if_t<internal::has_at<F>::value>>
+        constexpr std::optional<type> at(size_t i) const
+        {
+            return _fn.at(i);
+        }
+
+        // Reads up to n elements into out. Returns the number of read elements.
+        constexpr size_t next_batch(type *out, size_t n) const;
+
+        // Waits for the next element until the deadline and stores it in out.
+        // Available for timed sources (channel<T>::receive) through map, filter and async_map stages.
+        template<typename F = Fn, typename = std::enable_if_t<internal::has_next_until<F, type>::value>>
+        pull_status next_until(std::optional<type> &out, std::chrono::steady_clock::time_point deadline) const
+        {
+            return _fn.next_until(out, deadline);
+        }
+
+        // Makes the source notify signal when an element may have arrived, so a stage waiting for other events
+        // notices it too. Available for channel<T>::receive through map and filter stages.
+        template<typename Signal, typename F = Fn>
+        auto watch(Signal const &signal) const -> decltype(std::declval<F const &>().watch(signal))
+        {
+            return _fn.watch(signal);
+        }
+
+        // Splits off a stream producing the first part of the remaining elements, this one keeps the rest.
+        // Stateless stages over splittable sources carry the split through. Returns nullopt when the stream can't be split.
+        constexpr std::optional<stream> try_split() const;
+
+        // Approximate number of remaining elements used to balance splits, SIZE_MAX when it's unknown
+        constexpr size_t estimated_size() const;
+
         template<class OutputIt>
         constexpr void collect(OutputIt it) const;
 
+        // Short-circuiting terminal operations. They stop pulling as soon as the answer is known.
+        template<typename FnPredicate>
+        constexpr std::optional<type> find(FnPredicate && pred) const;
+
+        template<typename FnPredicate>
+        constexpr bool any_of(FnPredicate && pred) const;
+
+        template<typename FnPredicate>
+        constexpr bool all_of(FnPredicate && pred) const;
+
+        template<typename FnPredicate>
+        constexpr bool none_of(FnPredicate && pred) const;
+
+        constexpr std::optional<type> first() const;
+
+        constexpr std::optional<type> nth(size_t n) const;
+
+        // Terminal operations which drain the stream
+        constexpr size_t count() const;
+
+        template<typename Compare = std::less<>>
+        constexpr std::optional<type> min(Compare cmp = Compare{}) const;
+
+        template<typename Compare = std::less<>>
+        constexpr std::optional<type> max(Compare cmp = Compare{}) const;
+
+        constexpr type sum() const;
+
+        // Evaluates several accumulators in a single pass. Returns the tuple of their results.
+        // Accumulator provides push(v) and result(), or bind<T>() creating such an object for elements of type T.
+        template<typename... Aggs>
+        constexpr auto aggregate(Aggs &&... aggs) const;
+
         constexpr type collect() const
         {
             return next().value();
@@ -86,193 +354,1262 @@ namespace plusar
             mutable size_t value = 0;
         };
 
-        template<typename T>
-        class mutable_optional
+        constexpr size_t saturating_add(size_t a, size_t b)
         {
-            mutable std::optional<T> _value = std::nullopt;
+            return a > SIZE_MAX - b ? SIZE_MAX : a + b;
+        }
 
-        public:
-            void operator=(std::optional<T> const &rhs) const
-            {
-                if (rhs.has_value())
-                    _value.emplace(rhs.value());
-                else
-                    _value.reset();
-            }
+        constexpr size_t saturating_mul(size_t a, size_t b)
+        {
+            return b && a > SIZE_MAX / b ? SIZE_MAX : a * b;
+        }
 
-            std::optional<T> const & operator->() const
-            {
-                return _value;
-            }
+        constexpr size_t ceil_div(size_t a, size_t b)
+        {
+            return a / b + (a % b != 0);
+        }
+
+        // Function declared free of side effects, so its evaluation may be elided
+        template<typename Fn>
+        struct pure_fn
+        {
+            Fn fn;
 
-            operator bool() const
+            template<typename... Args>
+            constexpr decltype(auto) operator()(Args&&... args) const
             {
-                return _value.has_value();
+                return fn(std::forward<Args>(args)...);
             }
         };
-    }
 
-    template <typename Fn>
-    constexpr auto make_stream(Fn && fn)
-    {
-        return stream<std::decay_t<Fn>>(std::forward<Fn>(fn));
-    }
+        template<typename Fn>
+        struct is_pure : std::false_type {};
 
-    template <typename T, size_t N>
-    constexpr auto make_stream(T const (&arr)[N])
-    {
-        using internal::mutable_idx;
+        template<typename Fn>
+        struct is_pure<pure_fn<Fn>> : std::true_type {};
 
-        auto fn = [arr, n = mutable_idx{}]()
+        // Composition of two adjacent map functions: g(f(x))
+        template<typename F, typename G>
+        struct composition
         {
-            return n.value >= N
-                        ? std::nullopt
-                        : std::make_optional(arr[n.value++]);
+            F f;
+            G g;
+
+            template<typename T>
+            constexpr decltype(auto) operator()(T && v) const
+            {
+                return g(f(std::forward<T>(v)));
+            }
         };
-        return stream<decltype(fn)>(std::move(fn));
-    }
 
-    template<typename Fn>
-    template<typename FnPredicate>
-    constexpr auto stream<Fn>::filter(FnPredicate && pred) const
-    {
-        return make_stream([src = *this, pred = std::forward<FnPredicate>(pred)]() -> std::optional<type>
-        {
-            for(auto sv = src.next(); sv; sv = src.next())
-                if(pred(*sv))
-                    return sv;
-            return std::nullopt;
-        });
-    }
+        template<typename F, typename G>
+        struct is_pure<composition<F, G>> : std::bool_constant<is_pure<F>::value && is_pure<G>::value> {};
 
-    template<typename Fn>
-    template<typename FnR>
-    constexpr auto stream<Fn>::map(FnR && fn) const
-    {
-        return make_stream([src = *this, fn = std::forward<FnR>(fn)]()
+        // Conjunction of two adjacent filter predicates: p(x) && q(x)
+        template<typename P, typename Q>
+        struct predicate_and
         {
-            auto sv = src.next();
-            return sv ? std::make_optional(fn(*sv)) : std::nullopt;
-        });
-    }
+            P p;
+            Q q;
 
-    template<typename Fn>
-    template<typename FnR, typename R>
-    constexpr auto stream<Fn>::reduce(R && v, FnR && fn) const
-    {
-        return make_stream([src = *this, v = std::forward<R>(v), fn = std::forward<FnR>(fn)]()
+            template<typename T>
+            constexpr bool operator()(T const &v) const
+            {
+                return p(v) && q(v);
+            }
+        };
+
+        template<typename Src, typename FnR>
+        struct map_fn
         {
-            R res = v;
-            for(auto v = src.next(); v; v = src.next())
-                res = fn(res, *v);
-            return std::make_optional(res);
-        });
-    }
+            Src src;
+            FnR fn;
 
-    template<typename Fn>
-    constexpr auto stream<Fn>::flatten() const
-    {
-        using namespace internal;
+            constexpr auto operator()() const
+            {
+                auto sv = src.next();
+                return sv ? std::make_optional(fn(*sv)) : std::nullopt;
+            }
 
-        return make_stream([src = *this, current = mutable_optional<type>{}] () -> std::optional<typename type::type>
-        {
-            if (!current)
-                current = src.next();
+            template<typename T, typename S = Src>
+            auto next_until(std::optional<T> &out, std::chrono::steady_clock::time_point deadline) const
+                -> decltype(std::declval<S const &>().next_until(std::declval<std::optional<typename S::type> &>(), deadline))
+            {
+                std::optional<typename Src::type> sv;
+                auto const status = src.next_until(sv, deadline);
+                if (status == pull_status::ready)
+                    out.emplace(fn(*sv));
+                return status;
+            }
 
-            for(;current; current = src.next())
+            template<typename Signal, typename S = Src>
+            auto watch(Signal const &signal) const -> decltype(std::declval<S const &>().watch(signal))
             {
-                std::optional<typename type::type> const &v = current->next();
-                if (v)
-                    return v;
+                return src.watch(signal);
             }
 
-            return std::nullopt;
-        });
-    }
+            // Pure functions aren't evaluated for skipped elements
+            constexpr size_t advance(size_t n) const
+            {
+                if constexpr (is_pure<FnR>::value)
+                    return src.advance(n);
+                else
+                {
+                    size_t i = 0;
+                    for(; i < n && (*this)(); ++i);
+                    return i;
+                }
+            }
 
-    template<typename Fn>
-    constexpr auto stream<Fn>::take(size_t limit) const
-    {
-        using internal::mutable_idx;
+            constexpr std::optional<size_t> size_hint() const
+            {
+                return src.size_hint();
+            }
+
+            template<typename S = Src>
+            constexpr auto at(size_t i) const -> std::optional<std::decay_t<decltype(std::declval<FnR const &>()(*std::declval<S const &>().at(i)))>>
+            {
+                auto sv = src.at(i);
+                return sv ? std::make_optional(fn(*sv)) : std::nullopt;
+            }
+
+            constexpr std::optional<map_fn> try_split() const
+            {
+                auto part = src.try_split();
+                return part ? std::make_optional(map_fn{ *part, fn }) : std::nullopt;
+            }
+
+            constexpr size_t estimated_size() const
+            {
+                return src.estimated_size();
+            }
+        };
 
-        return make_stream([src = *this, n = mutable_idx{}, limit] () -> std::optional<type>
+        template<typename Src, typename FnPredicate>
+        struct filter_fn
         {
-            if (n.value >= limit)
+            Src src;
+            FnPredicate pred;
+
+            constexpr std::optional<typename Src::type> operator()() const
+            {
+                for(auto sv = src.next(); sv; sv = src.next())
+                    if(pred(*sv))
+                        return sv;
                 return std::nullopt;
-            ++n.value;
-            return src.next();
-        });
-    }
+            }
 
-    template<typename Fn>
-    constexpr auto stream<Fn>::skip(size_t limit) const
-    {
-        using internal::mutable_idx;
+            template<typename S = Src>
+            auto next_until(std::optional<typename Src::type> &out, std::chrono::steady_clock::time_point deadline) const
+                -> decltype(std::declval<S const &>().next_until(out, deadline))
+            {
+                for(;;)
+                {
+                    auto const status = src.next_until(out, deadline);
+                    if (status != pull_status::ready || pred(*out))
+                        return status;
+                    out.reset();
+                }
+            }
 
-        return make_stream([src = *this, n = mutable_idx{}, limit] () -> std::optional<type>
-        {
-            while(n.value < limit)
+            template<typename Signal, typename S = Src>
+            auto watch(Signal const &signal) const -> decltype(std::declval<S const &>().watch(signal))
             {
-                auto v = src.next();
-                if (!v)
-                    return v;
-                n.value++;
+                return src.watch(signal);
             }
-            return src.next();
-        });
-    }
 
-    template<typename Fn>
-    template<typename FnStream, typename FnZip>
-    constexpr auto stream<Fn>::zip(stream<FnStream> && other, FnZip && fn) const
-    {
-        return make_stream([src = *this, other = std::forward<stream<FnStream>>(other), fn = std::forward<FnZip>(fn)] ()
+            constexpr std::optional<filter_fn> try_split() const
+            {
+                auto part = src.try_split();
+                return part ? std::make_optional(filter_fn{ *part, pred }) : std::nullopt;
+            }
+
+            constexpr size_t estimated_size() const
+            {
+                return src.estimated_size();
+            }
+        };
+
+        template<typename Src>
+        struct take_fn
         {
-            auto a = src.next();
-            auto b = other.next();
-            return a && b ? std::make_optional(fn(*a, *b)) : std::nullopt;
-        });
-    }
+            Src src;
+            size_t limit;
+            mutable_idx n;
 
-    template<typename Fn>
-    constexpr auto stream<Fn>::slice(size_t start, size_t end, size_t step) const
-    {
-        if (!step)
-            step = 1;
-        if (end < start)
-            end = start;
-        return slice_to_end(start, step)
-                    .take((end - start + step - 1) / step);
-    }
+            constexpr std::optional<typename Src::type> operator()() const
+            {
+                if (n.value >= limit)
+                    return std::nullopt;
+                ++n.value;
+                return src.next();
+            }
 
-    template<typename Fn>
-    constexpr auto stream<Fn>::slice_to_end(size_t start, size_t step) const
-    {
-        if (!step)
-            step = 1;
+            constexpr size_t advance(size_t count) const
+            {
+                count = std::min(count, limit - n.value);
+                n.value += count;
+                return src.advance(count);
+            }
+
+            constexpr std::optional<size_t> size_hint() const
+            {
+                auto const size = src.size_hint();
+                return size ? std::make_optional(std::min(*size, limit - n.value)) : std::nullopt;
+            }
+
+            template<typename S = Src>
+            constexpr auto at(size_t i) const -> decltype(std::declval<S const &>().at(i))
+            {
+                return i < limit - n.value ? src.at(i) : std::nullopt;
+            }
+
+            constexpr size_t next_batch(typename Src::type *out, size_t count) const
+            {
+                count = src.next_batch(out, std::min(count, limit - n.value));
+                n.value += count;
+                return count;
+            }
+        };
 
-        return make_stream([src = skip(start), step] () -> std::optional<type>
+        template<typename Src>
+        struct skip_fn
         {
-            auto v = src.next();
-            if (!v)
-                return v;
+            Src src;
+            size_t limit;
+            mutable_idx n;
 
-            for(size_t i = 1; i < step; ++i)
+            constexpr bool skipped() const
             {
-                auto t = src.next();
-                if (!t)
-                    break;
+                if (n.value < limit)
+                    n.value += src.advance(limit - n.value);
+                return n.value >= limit;
             }
 
-            return v;
-        });
-    }
+            constexpr std::optional<typename Src::type> operator()() const
+            {
+                return skipped() ? src.next() : std::nullopt;
+            }
 
-    template<typename Fn>
-    template<class OutputIt>
-    constexpr void stream<Fn>::collect(OutputIt it) const
-    {
-        for(auto v = next(); v; v = next())
-            ++it = v.value();
+            constexpr size_t advance(size_t count) const
+            {
+                return skipped() ? src.advance(count) : 0;
+            }
+
+            constexpr std::optional<size_t> size_hint() const
+            {
+                auto const size = src.size_hint();
+                if (!size || *size == SIZE_MAX)
+                    return size;
+                size_t const pending = limit - n.value;
+                return *size > pending ? *size - pending : 0;
+            }
+
+            template<typename S = Src>
+            constexpr auto at(size_t i) const -> decltype(std::declval<S const &>().at(i))
+            {
+                return src.at(saturating_add(limit - n.value, i));
+            }
+
+            constexpr size_t next_batch(typename Src::type *out, size_t count) const
+            {
+                return skipped() ? src.next_batch(out, count) : 0;
+            }
+        };
+
+        // Emits every step-th element of the source
+        template<typename Src>
+        struct stride_fn
+        {
+            Src src;
+            size_t step;
+
+            constexpr std::optional<typename Src::type> operator()() const
+            {
+                auto v = src.next();
+                if (v)
+                    src.advance(step - 1);
+                return v;
+            }
+
+            constexpr size_t advance(size_t n) const
+            {
+                return ceil_div(src.advance(saturating_mul(n, step)), step);
+            }
+
+            constexpr std::optional<size_t> size_hint() const
+            {
+                auto const size = src.size_hint();
+                if (!size || *size == SIZE_MAX)
+                    return size;
+                return ceil_div(*size, step);
+            }
+
+            template<typename S = Src>
+            constexpr auto at(size_t i) const -> decltype(std::declval<S const &>().at(i))
+            {
+                return src.at(saturating_mul(i, step));
+            }
+        };
+
+        // Pulls the elements of the inner streams in turn. The current inner stream lives in place and
+        // is replaced by moving the next one in, so its captured state is never copied.
+        template<typename Src>
+        struct flatten_fn
+        {
+            using inner = typename Src::type;
+
+            Src src;
+            mutable std::optional<inner> current;
+
+            constexpr std::optional<typename inner::type> operator()() const
+            {
+                for(;;)
+                {
+                    if (current)
+                    {
+                        if (auto v = current->next())
+                            return v;
+                    }
+
+                    auto next = src.next();
+                    if (!next)
+                        return std::nullopt;
+                    current.reset();                // inner streams aren't assignable
+                    current.emplace(std::move(*next));
+                }
+            }
+        };
+
+        // fn appends the elements produced from every source element to a buffer, which keeps its capacity
+        // from one source element to the next
+        template<typename Src, typename FnR, typename R>
+        struct flat_map_fn
+        {
+            Src src;
+            FnR fn;
+            mutable std::vector<R> buffer;
+            mutable_idx pos;
+
+            constexpr std::optional<R> operator()() const
+            {
+                while(pos.value == buffer.size())
+                {
+                    auto e = src.next();
+                    if (!e)
+                        return std::nullopt;
+                    buffer.clear();
+                    pos.value = 0;
+                    fn(std::move(*e), buffer);
+                }
+
+                return std::move(buffer[pos.value++]);
+            }
+        };
+
+        // fn returns the inner stream of every element, which is built directly in the slot of the previous one
+        template<typename Src, typename FnR>
+        struct flat_map_fn<Src, FnR, void>
+        {
+            using inner = std::decay_t<std::invoke_result_t<FnR const &, typename Src::type>>;
+
+            Src src;
+            FnR fn;
+            mutable std::optional<inner> current;
+
+            constexpr std::optional<typename inner::type> operator()() const
+            {
+                for(;;)
+                {
+                    if (current)
+                    {
+                        if (auto v = current->next())
+                            return v;
+                    }
+
+                    auto e = src.next();
+                    if (!e)
+                        return std::nullopt;
+                    current.reset();
+                    current.emplace(fn(std::move(*e)));
+                }
+            }
+        };
+
+        // Every chunk is read by a take counter which is rewound for the next chunk
+        template<typename Src, bool Owning>
+        struct chunk_fn
+        {
+            using type = typename Src::type;
+            using result = std::conditional_t<Owning, std::vector<type>, chunk_view<type>>;
+
+            take_fn<Src> part;
+            mutable std::vector<type> buffer;
+
+            size_t fill(std::vector<type> &out) const
+            {
+                part.n.value = 0;
+                if constexpr (std::is_default_constructible<type>::value)
+                {
+                    out.resize(part.limit);
+                    size_t const count = part.next_batch(out.data(), part.limit);
+                    if constexpr (Owning)
+                        out.resize(count);
+                    return count;
+                }
+                else
+                {
+                    out.clear();
+                    for(auto v = part(); v; v = part())
+                        out.push_back(std::move(*v));
+                    return out.size();
+                }
+            }
+
+            std::optional<result> operator()() const
+            {
+                if constexpr (Owning)
+                {
+                    std::vector<type> out;
+                    return fill(out) ? std::make_optional(std::move(out)) : std::nullopt;
+                }
+                else
+                {
+                    size_t const count = fill(buffer);
+                    return count ? std::make_optional(result(buffer.data(), count)) : std::nullopt;
+                }
+            }
+
+            constexpr size_t advance(size_t count) const
+            {
+                return ceil_div(part.src.advance(saturating_mul(count, part.limit)), part.limit);
+            }
+
+            constexpr std::optional<size_t> size_hint() const
+            {
+                auto const size = part.src.size_hint();
+                return size && *size != SIZE_MAX ? std::make_optional(ceil_div(*size, part.limit)) : size;
+            }
+        };
+
+        template<typename Src>
+        struct batch_fn
+        {
+            using clock = std::chrono::steady_clock;
+            using type = typename Src::type;
+
+            Src src;
+            size_t max_size;
+            std::chrono::nanoseconds max_delay;
+
+            clock::time_point deadline() const
+            {
+                auto const now = clock::now();
+                return max_delay < clock::time_point::max() - now ? now + max_delay : clock::time_point::max();
+            }
+
+            // Timed sources are pulled by next_until only, so stages like async_map don't block on their source
+            std::optional<type> first() const
+            {
+                if constexpr (has_next_until<Src, type>::value)
+                {
+                    std::optional<type> v;
+                    src.next_until(v, clock::time_point::max());
+                    return v;
+                }
+                else
+                    return src.next();
+            }
+
+            std::optional<std::vector<type>> operator()() const
+            {
+                auto first = this->first();
+                if (!first)
+                    return std::nullopt;
+
+                auto const until = deadline();
+                std::vector<type> out;
+                out.reserve(std::min<size_t>(max_size, 1024));
+                out.push_back(std::move(*first));
+
+                while(out.size() < max_size)
+                {
+                    std::optional<type> v;
+                    if constexpr (has_next_until<Src, type>::value)
+                    {
+                        if (src.next_until(v, until) != pull_status::ready)
+                            break;
+                    }
+                    else
+                    {
+                        if (clock::now() >= until || !(v = src.next()))
+                            break;
+                    }
+                    out.push_back(std::move(*v));
+                }
+                return out;
+            }
+        };
+
+        template<typename T, size_t N>
+        struct array_fn
+        {
+            std::array<T, N> values;
+            mutable_idx n;
+            size_t end = N;
+
+            constexpr size_t remaining() const
+            {
+                return end - n.value;
+            }
+
+            constexpr std::optional<T> operator()() const
+            {
+                return n.value >= end
+                            ? std::nullopt
+                            : std::make_optional(values[n.value++]);
+            }
+
+            constexpr size_t advance(size_t count) const
+            {
+                count = std::min(count, remaining());
+                n.value += count;
+                return count;
+            }
+
+            constexpr std::optional<size_t> size_hint() const
+            {
+                return remaining();
+            }
+
+            constexpr std::optional<T> at(size_t i) const
+            {
+                return i < remaining() ? std::make_optional(values[n.value + i]) : std::nullopt;
+            }
+
+            constexpr size_t next_batch(T *out, size_t count) const
+            {
+                count = std::min(count, remaining());
+                std::copy_n(values.begin() + n.value, count, out);
+                n.value += count;
+                return count;
+            }
+
+            constexpr std::optional<array_fn> try_split() const
+            {
+                if (remaining() < 2)
+                    return std::nullopt;
+                size_t const half = n.value + remaining() / 2;
+                array_fn prefix{ values, n, half };
+                n.value = half;
+                return prefix;
+            }
+        };
+
+        // Shares the container between copies and splits of the stream
+        template<typename C>
+        struct container_fn
+        {
+            using iterator = typename C::const_iterator;
+            using value_type = typename C::value_type;
+
+            std::shared_ptr<C const> data;
+            mutable iterator it;
+            mutable size_t size;
+
+            constexpr std::optional<value_type> operator()() const
+            {
+                if (!size)
+                    return std::nullopt;
+                --size;
+                return *it++;
+            }
+
+            constexpr size_t advance(size_t count) const
+            {
+                count = std::min(count, size);
+                std::advance(it, count);
+                size -= count;
+                return count;
+            }
+
+            constexpr std::optional<size_t> size_hint() const
+            {
+                return size;
+            }
+
+            template<typename I = iterator,
+                     typename = std::enable_if_t<std::is_base_of<std::random_access_iterator_tag, typename std::iterator_traits<I>::iterator_category>::value>>
+            constexpr std::optional<value_type> at(size_t i) const
+            {
+                return i < size ? std::make_optional(it[i]) : std::nullopt;
+            }
+
+            constexpr size_t next_batch(value_type *out, size_t count) const
+            {
+                count = std::min(count, size);
+                for(size_t i = 0; i < count; ++i, ++it)
+                    out[i] = *it;
+                size -= count;
+                return count;
+            }
+
+            std::optional<container_fn> try_split() const
+            {
+                if (size < 2)
+                    return std::nullopt;
+                size_t const half = size / 2;
+                container_fn prefix{ data, it, half };
+                std::advance(it, half);
+                size -= half;
+                return prefix;
+            }
+        };
+
+        // Arithmetic progression first, first + step, ... of 'size' elements (SIZE_MAX for endless one)
+        template<typename T>
+        struct range_fn
+        {
+            T first;
+            T step;
+            size_t size;
+            mutable_idx n;
+
+            constexpr bool endless() const
+            {
+                return size == SIZE_MAX;
+            }
+
+            constexpr size_t remaining() const
+            {
+                return endless() ? SIZE_MAX : size - n.value;
+            }
+
+            constexpr T value(size_t i) const
+            {
+                return static_cast<T>(first + static_cast<T>(i) * step);
+            }
+
+            constexpr std::optional<T> operator()() const
+            {
+                return remaining()
+                            ? std::make_optional(value(n.value++))
+                            : std::nullopt;
+            }
+
+            constexpr size_t advance(size_t count) const
+            {
+                count = std::min(count, remaining());
+                n.value = saturating_add(n.value, count);
+                return count;
+            }
+
+            constexpr std::optional<size_t> size_hint() const
+            {
+                return remaining();
+            }
+
+            constexpr std::optional<T> at(size_t i) const
+            {
+                return i < remaining()
+                            ? std::make_optional(value(n.value + i))
+                            : std::nullopt;
+            }
+
+            // Branch free loop the compiler turns into vector instructions
+            constexpr size_t next_batch(T *out, size_t count) const
+            {
+                count = std::min(count, remaining());
+                size_t const base = n.value;
+                for(size_t i = 0; i < count; ++i)
+                    out[i] = value(base + i);
+                n.value += count;
+                return count;
+            }
+
+            // Endless progressions aren't split
+            constexpr std::optional<range_fn> try_split() const
+            {
+                if (endless() || remaining() < 2)
+                    return std::nullopt;
+                size_t const half = n.value + remaining() / 2;
+                range_fn prefix{ first, step, half, n };
+                n.value = half;
+                return prefix;
+            }
+
+            // Sum of the remaining elements modulo 2^64 (finite integral ranges only)
+            constexpr uint64_t wrapped_sum() const
+            {
+                uint64_t const k = remaining();
+                uint64_t const pairs = k % 2 ? k * ((k - 1) / 2) : (k / 2) * (k - 1);
+                return static_cast<uint64_t>(value(n.value)) * k + static_cast<uint64_t>(step) * pairs;
+            }
+        };
+
+        template<typename T>
+        constexpr size_t range_size(T begin, T end, T step)
+        {
+            if constexpr (std::is_integral<T>::value)
+            {
+                if (step > T{})
+                    return end > begin
+                            ? static_cast<size_t>((static_cast<uint64_t>(end) - static_cast<uint64_t>(begin) - 1) / static_cast<uint64_t>(step) + 1)
+                            : 0;
+                return begin > end
+                            ? static_cast<size_t>((static_cast<uint64_t>(begin) - static_cast<uint64_t>(end) - 1) / (0 - static_cast<uint64_t>(step)) + 1)
+                            : 0;
+            }
+            else
+            {
+                auto const size = std::ceil((end - begin) / step);
+                return size > 0 ? static_cast<size_t>(size) : 0;
+            }
+        }
+
+        template<typename T, size_t N, size_t... I>
+        constexpr std::array<T, N> to_array(T const (&arr)[N], std::index_sequence<I...>)
+        {
+            return {{ arr[I]... }};
+        }
+
+        // Defined in plusar/parallel.hpp
+        template<typename Src, typename FnR, bool Ordered>
+        struct parallel_map_fn;
+
+        // Defined in plusar/async.hpp
+        template<typename Src, typename FnR, typename R, bool Ordered>
+        struct async_map_fn;
+
+        // Defined in plusar/sort.hpp
+        template<typename Src, typename Cmp>
+        struct sort_fn;
+
+        template<typename T, typename Key>
+        struct key_sort;
+
+        // Defined in plusar/tee.hpp
+        template<typename Src>
+        struct tee_state;
+
+        template<typename Src>
+        struct tee_fn;
+
+        // Defined in plusar/histogram.hpp
+        template<typename Src>
+        struct mark_ingest_fn;
+
+        template<typename Src>
+        struct record_latency_fn;
+
+        template<typename Fn>                       struct is_map_fn                        : std::false_type {};
+        template<typename Src, typename FnR>        struct is_map_fn<map_fn<Src, FnR>>      : std::true_type {};
+        template<typename Fn>                       struct is_filter_fn                     : std::false_type {};
+        template<typename Src, typename FnP>        struct is_filter_fn<filter_fn<Src, FnP>>: std::true_type {};
+        template<typename Fn>                       struct is_take_fn                       : std::false_type {};
+        template<typename Src>                      struct is_take_fn<take_fn<Src>>         : std::true_type {};
+        template<typename Fn>                       struct is_skip_fn                       : std::false_type {};
+        template<typename Src>                      struct is_skip_fn<skip_fn<Src>>         : std::true_type {};
+        template<typename Fn>                       struct is_range_fn                      : std::false_type {};
+        template<typename T>                        struct is_range_fn<range_fn<T>>         : std::true_type {};
+
+        template<typename Fn>                       struct is_plus                          : std::false_type {};
+        template<typename T>                        struct is_plus<std::plus<T>>            : std::true_type {};
+    }
+
+    namespace internal
+    {
+#ifndef PLUSAR_INSTRUMENT
+        template<typename Fn>
+        struct stage
+        {
+            using type = Fn;
+        };
+#endif
+
+        // Stage type with instrumentation stripped
+        template<typename Fn>
+        using stage_t = typename stage<Fn>::type;
+
+        // Streams of library stages are built here, so instrumentation wraps every stage when PLUSAR_INSTRUMENT is defined
+        template<typename Stage>
+        constexpr auto make_stage([[maybe_unused]] char const *name, Stage && s)
+        {
+#ifdef PLUSAR_INSTRUMENT
+            return stream<probed<std::decay_t<Stage>>>(probed<std::decay_t<Stage>>(std::forward<Stage>(s), name));
+#else
+            return stream<std::decay_t<Stage>>(std::forward<Stage>(s));
+#endif
+        }
+    }
+
+    template <typename Fn, std::enable_if_t<std::is_invocable<std::decay_t<Fn> const &>::value, int> = 0>
+    constexpr auto make_stream(Fn && fn)
+    {
+        return internal::make_stage("source", std::forward<Fn>(fn));
+    }
+
+    // Stream over the elements of a container. The container is moved or copied into storage shared by the stream copies.
+    template <typename C, std::enable_if_t<!std::is_invocable<std::decay_t<C> const &>::value, int> = 0,
+              typename = typename std::decay_t<C>::const_iterator>
+    auto make_stream(C && c)
+    {
+        using container = std::decay_t<C>;
+        auto data = std::make_shared<container const>(std::forward<C>(c));
+        auto begin = data->begin();
+        size_t const size = std::distance(begin, data->end());
+        return internal::make_stage("container", internal::container_fn<container>{ std::move(data), begin, size });
+    }
+
+    template <typename T, size_t N>
+    constexpr auto make_stream(T const (&arr)[N])
+    {
+        using namespace internal;
+        return make_stage("array", array_fn<T, N>{ to_array(arr, std::make_index_sequence<N>{}), mutable_idx{} });
+    }
+
+    // Finite arithmetic progression [begin, end) with the given step
+    template <typename T>
+    constexpr auto make_range(T begin, T end, T step = 1)
+    {
+        using namespace internal;
+        if (step == T{})
+            step = 1;
+        return make_stage("range", range_fn<T>{ begin, step, range_size(begin, end, step), mutable_idx{} });
+    }
+
+    // Endless arithmetic progression begin, begin + step, ...
+    template <typename T>
+    constexpr auto iota(T begin, T step = 1)
+    {
+        using namespace internal;
+        return make_stage("iota", range_fn<T>{ begin, step, SIZE_MAX, mutable_idx{} });
+    }
+
+    // Marks a map function as free of side effects.
+    // Elements dropped by skip or slice are then never passed to it.
+    template <typename Fn>
+    constexpr auto pure(Fn && fn)
+    {
+        return internal::pure_fn<std::decay_t<Fn>>{ std::forward<Fn>(fn) };
+    }
+
+    // Adjacent filters are fused into a single predicate
+    template<typename Fn>
+    template<typename FnPredicate>
+    constexpr auto stream<Fn>::filter(FnPredicate && pred) const
+    {
+        using namespace internal;
+
+        if constexpr (is_filter_fn<stage_t<Fn>>::value)
+        {
+            using fused = predicate_and<decltype(_fn.pred), std::decay_t<FnPredicate>>;
+            return make_stage("filter", filter_fn<decltype(_fn.src), fused>{ _fn.src, fused{ _fn.pred, std::forward<FnPredicate>(pred) } });
+        }
+        else
+            return make_stage("filter", filter_fn<stream, std::decay_t<FnPredicate>>{ *this, std::forward<FnPredicate>(pred) });
+    }
+
+    // Adjacent maps are fused into a single function composition
+    template<typename Fn>
+    template<typename FnR>
+    constexpr auto stream<Fn>::map(FnR && fn) const
+    {
+        using namespace internal;
+
+        if constexpr (is_map_fn<stage_t<Fn>>::value)
+        {
+            using fused = composition<decltype(_fn.fn), std::decay_t<FnR>>;
+            return make_stage("map", map_fn<decltype(_fn.src), fused>{ _fn.src, fused{ _fn.fn, std::forward<FnR>(fn) } });
+        }
+        else
+            return make_stage("map", map_fn<stream, std::decay_t<FnR>>{ *this, std::forward<FnR>(fn) });
+    }
+
+    template<typename Fn>
+    template<typename FnR>
+    constexpr auto stream<Fn>::parallel_map(FnR && fn, size_t workers, size_t window) const
+    {
+        return internal::make_stage("parallel_map", internal::parallel_map_fn<stream, std::decay_t<FnR>, true>(*this, std::forward<FnR>(fn), workers, window));
+    }
+
+    template<typename Fn>
+    template<typename FnR>
+    constexpr auto stream<Fn>::parallel_map_unordered(FnR && fn, size_t workers, size_t window) const
+    {
+        return internal::make_stage("parallel_map", internal::parallel_map_fn<stream, std::decay_t<FnR>, false>(*this, std::forward<FnR>(fn), workers, window));
+    }
+
+    template<typename Fn>
+    template<typename R, typename FnR>
+    constexpr auto stream<Fn>::async_map(FnR && fn, size_t max_in_flight, std::chrono::nanoseconds timeout) const
+    {
+        return internal::make_stage("async_map", internal::async_map_fn<stream, std::decay_t<FnR>, R, true>(*this, std::forward<FnR>(fn), max_in_flight, timeout));
+    }
+
+    template<typename Fn>
+    template<typename R, typename FnR>
+    constexpr auto stream<Fn>::async_map_unordered(FnR && fn, size_t max_in_flight, std::chrono::nanoseconds timeout) const
+    {
+        return internal::make_stage("async_map", internal::async_map_fn<stream, std::decay_t<FnR>, R, false>(*this, std::forward<FnR>(fn), max_in_flight, timeout));
+    }
+
+    template<typename Fn>
+    constexpr auto stream<Fn>::tee(size_t n, size_t chunk_size, std::pmr::memory_resource *resource) const
+    {
+        using namespace internal;
+
+        auto state = std::make_shared<tee_state<stream>>(*this, chunk_size, resource);
+        std::vector<decltype(make_stage("tee", tee_fn<stream>(state)))> branches;
+        branches.reserve(n);
+        for(size_t i = 0; i < n; ++i)
+            branches.push_back(make_stage("tee", tee_fn<stream>(state)));
+        return branches;
+    }
+
+    template<typename Fn>
+    template<typename Compare>
+    constexpr auto stream<Fn>::sort(Compare cmp) const
+    {
+        return internal::make_stage("sort", internal::sort_fn<stream, Compare>(*this, std::move(cmp), SIZE_MAX));
+    }
+
+    template<typename Fn>
+    template<typename Compare>
+    constexpr auto stream<Fn>::sort(Compare cmp, size_t memory_budget) const
+    {
+        static_assert(internal::sort_fn<stream, Compare>::spillable, "elements sorted within a memory budget must be trivially copyable or have a plusar::spill_serializer");
+        return internal::make_stage("sort", internal::sort_fn<stream, Compare>(*this, std::move(cmp), memory_budget));
+    }
+
+    template<typename Fn>
+    template<typename Key>
+    std::vector<typename stream<Fn>::type> stream<Fn>::sorted(Key key, bool stable, thread_pool *pool) const
+    {
+        std::vector<type> v;
+        if (auto const size = size_hint(); size && *size != SIZE_MAX)
+            v.reserve(*size);
+        collect(std::back_inserter(v));
+        internal::key_sort<type, Key>{ std::move(key), stable }(v, pool);
+        return v;
+    }
+
+    template<typename Fn>
+    constexpr auto stream<Fn>::cache(size_t memory_limit, std::pmr::memory_resource *resource) const
+    {
+        return cached<stream>(*this, memory_limit, resource);
+    }
+
+    template<typename Fn>
+    constexpr auto stream<Fn>::mark_ingest() const
+    {
+        return internal::make_stage("mark_ingest", internal::mark_ingest_fn<stream>{ *this });
+    }
+
+    template<typename Fn>
+    constexpr auto stream<Fn>::record_latency(latency_histogram &histogram) const
+    {
+        return internal::make_stage("record_latency", internal::record_latency_fn<stream>{ *this, &histogram, std::nullopt });
+    }
+
+    template<typename Fn>
+    template<typename FnR, typename R>
+    constexpr auto stream<Fn>::reduce(R && v, FnR && fn) const
+    {
+        return internal::make_stage("reduce", [src = *this, v = std::forward<R>(v), fn = std::forward<FnR>(fn)]()
+        {
+            using namespace internal;
+
+            R res = v;
+
+            // Sum of a finite integral progression has a closed form
+            if constexpr (is_range_fn<stage_t<Fn>>::value
+                          && is_plus<std::decay_t<FnR>>::value
+                          && std::is_integral<type>::value
+                          && std::is_integral<std::decay_t<R>>::value)
+            {
+                if (!src._fn.endless())
+                {
+                    res = static_cast<R>(res + static_cast<std::decay_t<R>>(src._fn.wrapped_sum()));
+                    src.advance(SIZE_MAX);
+                    return std::make_optional(res);
+                }
+            }
+
+            for(auto v = src.next(); v; v = src.next())
+                res = fn(res, *v);
+            return std::make_optional(res);
+        });
+    }
+
+    template<typename Fn>
+    constexpr auto stream<Fn>::flatten() const
+    {
+        using namespace internal;
+
+        return make_stage("flatten", flatten_fn<stream>{ *this, std::nullopt });
+    }
+
+    template<typename Fn>
+    template<typename R, typename FnR>
+    constexpr auto stream<Fn>::flat_map(FnR && fn) const
+    {
+        return internal::make_stage("flat_map", internal::flat_map_fn<stream, std::decay_t<FnR>, R>{ *this, std::forward<FnR>(fn) });
+    }
+
+    // take(a).take(b) collapses to a single counter
+    template<typename Fn>
+    constexpr auto stream<Fn>::take(size_t limit) const
+    {
+        using namespace internal;
+
+        if constexpr (is_take_fn<stage_t<Fn>>::value)
+        {
+            size_t const fused = std::min(_fn.limit, saturating_add(_fn.n.value, limit));
+            return make_stage("take", take_fn<decltype(_fn.src)>{ _fn.src, fused, _fn.n });
+        }
+        else
+            return make_stage("take", take_fn<stream>{ *this, limit, mutable_idx{} });
+    }
+
+    // skip(a).skip(b) collapses to a single counter
+    template<typename Fn>
+    constexpr auto stream<Fn>::skip(size_t limit) const
+    {
+        using namespace internal;
+
+        if constexpr (is_skip_fn<stage_t<Fn>>::value)
+            return make_stage("skip", skip_fn<decltype(_fn.src)>{ _fn.src, saturating_add(_fn.limit, limit), _fn.n });
+        else
+            return make_stage("skip", skip_fn<stream>{ *this, limit, mutable_idx{} });
+    }
+
+    template<typename Fn>
+    constexpr auto stream<Fn>::chunk(size_t n) const
+    {
+        using namespace internal;
+        return make_stage("chunk", chunk_fn<stream, false>{ take_fn<stream>{ *this, std::max<size_t>(n, 1), mutable_idx{} }, {} });
+    }
+
+    template<typename Fn>
+    constexpr auto stream<Fn>::chunk_vector(size_t n) const
+    {
+        using namespace internal;
+        return make_stage("chunk", chunk_fn<stream, true>{ take_fn<stream>{ *this, std::max<size_t>(n, 1), mutable_idx{} }, {} });
+    }
+
+    template<typename Fn>
+    constexpr auto stream<Fn>::batch(size_t max_size, std::chrono::nanoseconds max_delay) const
+    {
+        return internal::make_stage("batch", internal::batch_fn<stream>{ *this, std::max<size_t>(max_size, 1), max_delay });
+    }
+
+    template<typename Fn>
+    template<typename FnStream, typename FnZip>
+    constexpr auto stream<Fn>::zip(stream<FnStream> && other, FnZip && fn) const
+    {
+        return internal::make_stage("zip", [src = *this, other = std::forward<stream<FnStream>>(other), fn = std::forward<FnZip>(fn)] ()
+        {
+            auto a = src.next();
+            auto b = other.next();
+            return a && b ? std::make_optional(fn(*a, *b)) : std::nullopt;
+        });
+    }
+
+    template<typename Fn>
+    constexpr auto stream<Fn>::slice(size_t start, size_t end, size_t step) const
+    {
+        if (!step)
+            step = 1;
+        if (end < start)
+            end = start;
+        return slice_to_end(start, step)
+                    .take((end - start + step - 1) / step);
+    }
+
+    template<typename Fn>
+    constexpr auto stream<Fn>::slice_to_end(size_t start, size_t step) const
+    {
+        if (!step)
+            step = 1;
+
+        auto src = skip(start);
+        return internal::make_stage("slice", internal::stride_fn<decltype(src)>{ src, step });
+    }
+
+    template<typename Fn>
+    constexpr std::optional<size_t> stream<Fn>::size_hint() const
+    {
+        if constexpr (internal::has_size_hint<Fn>::value)
+            return _fn.size_hint();
+        else
+            return std::nullopt;
+    }
+
+    template<typename Fn>
+    constexpr size_t stream<Fn>::next_batch(type *out, size_t n) const
+    {
+        if constexpr (internal::has_next_batch<Fn, type>::value)
+            return _fn.next_batch(out, n);
+        else
+        {
+            size_t i = 0;
+            for(; i < n; ++i)
+            {
+                auto v = next();
+                if (!v)
+                    break;
+                out[i] = std::move(*v);
+            }
+            return i;
+        }
+    }
+
+    template<typename Fn>
+    constexpr std::optional<stream<Fn>> stream<Fn>::try_split() const
+    {
+        if constexpr (internal::has_try_split<Fn>::value)
+        {
+            auto part = _fn.try_split();
+            return part ? std::make_optional<stream>(std::move(*part)) : std::nullopt;
+        }
+        else
+            return std::nullopt;
+    }
+
+    template<typename Fn>
+    constexpr size_t stream<Fn>::estimated_size() const
+    {
+        if constexpr (internal::has_estimated_size<Fn>::value)
+            return _fn.estimated_size();
+        else
+        {
+            auto const size = size_hint();
+            return size ? *size : SIZE_MAX;
+        }
+    }
+
+    template<typename Fn>
+    constexpr size_t stream<Fn>::advance(size_t n) const
+    {
+        if constexpr (internal::has_advance<Fn>::value)
+            return _fn.advance(n);
+        else
+        {
+            size_t i = 0;
+            for(; i < n && next(); ++i);
+            return i;
+        }
+    }
+
+    template<typename Fn>
+    template<class OutputIt>
+    constexpr void stream<Fn>::collect(OutputIt it) const
+    {
+        for(auto v = next(); v; v = next())
+            ++it = v.value();
+    }
+
+    template<typename Fn>
+    template<typename FnPredicate>
+    constexpr std::optional<typename stream<Fn>::type> stream<Fn>::find(FnPredicate && pred) const
+    {
+        for(auto v = next(); v; v = next())
+            if (pred(*v))
+                return v;
+        return std::nullopt;
+    }
+
+    template<typename Fn>
+    template<typename FnPredicate>
+    constexpr bool stream<Fn>::any_of(FnPredicate && pred) const
+    {
+        return find(std::forward<FnPredicate>(pred)).has_value();
+    }
+
+    template<typename Fn>
+    template<typename FnPredicate>
+    constexpr bool stream<Fn>::all_of(FnPredicate && pred) const
+    {
+        return !find([&pred](type const &v) { return !pred(v); });
+    }
+
+    template<typename Fn>
+    template<typename FnPredicate>
+    constexpr bool stream<Fn>::none_of(FnPredicate && pred) const
+    {
+        return !any_of(std::forward<FnPredicate>(pred));
+    }
+
+    template<typename Fn>
+    constexpr std::optional<typename stream<Fn>::type> stream<Fn>::first() const
+    {
+        return next();
+    }
+
+    // Random access streams jump straight to the element
+    template<typename Fn>
+    constexpr std::optional<typename stream<Fn>::type> stream<Fn>::nth(size_t n) const
+    {
+        return advance(n) == n ? next() : std::nullopt;
+    }
+
+    // Streams which know their size are counted without producing elements
+    template<typename Fn>
+    constexpr size_t stream<Fn>::count() const
+    {
+        auto const size = size_hint();
+        return advance(size ? *size : SIZE_MAX);
+    }
+
+    template<typename Fn>
+    template<typename Compare>
+    constexpr std::optional<typename stream<Fn>::type> stream<Fn>::min(Compare cmp) const
+    {
+        auto res = next();
+        if (res)
+            for(auto v = next(); v; v = next())
+                if (cmp(*v, *res))
+                    res = std::move(v);
+        return res;
+    }
+
+    template<typename Fn>
+    template<typename Compare>
+    constexpr std::optional<typename stream<Fn>::type> stream<Fn>::max(Compare cmp) const
+    {
+        auto res = next();
+        if (res)
+            for(auto v = next(); v; v = next())
+                if (cmp(*res, *v))
+                    res = std::move(v);
+        return res;
+    }
+
+    template<typename Fn>
+    constexpr typename stream<Fn>::type stream<Fn>::sum() const
+    {
+        return reduce(type{}, std::plus<>()).collect();
+    }
+
+    template<typename Fn>
+    template<typename... Aggs>
+    constexpr auto stream<Fn>::aggregate(Aggs &&... aggs) const
+    {
+        auto bind = [](auto &&agg)
+        {
+            using agg_type = std::decay_t<decltype(agg)>;
+            if constexpr (internal::has_bind<agg_type, type>::value)
+                return agg.template bind<type>();
+            else
+                return agg_type(std::forward<decltype(agg)>(agg));
+        };
+
+        auto accs = std::make_tuple(bind(std::forward<Aggs>(aggs))...);
+
+        for(auto v = next(); v; v = next())
+            std::apply([&v](auto &... acc) { (acc.push(*v), ...); }, accs);
+
+        return std::apply([](auto const &... acc) { return std::make_tuple(acc.result()...); }, accs);
     }
 }
@@ -0,0 +1,134 @@
+#pragma once
+#include <plusar/stream.hpp>
+#include <memory_resource>
+#include <optional>
+#include <memory>
+#include <atomic>
+#include <mutex>
+
+namespace plusar::internal
+{
+    // Block of elements shared by the branches of a tee. Elements below count are immutable and read without locking.
+    template<typename T>
+    struct tee_chunk
+    {
+        using allocator = std::pmr::polymorphic_allocator<std::optional<T>>;
+
+        allocator                  alloc;
+        std::optional<T>          *items;
+        size_t                     capacity;
+        std::atomic<size_t>        count{ 0 };
+        std::shared_ptr<tee_chunk> next;       // set before the chunk is full
+
+        tee_chunk(size_t capacity, std::pmr::memory_resource *resource):
+            alloc(resource),
+            items(alloc.allocate(capacity)),
+            capacity(capacity)
+        {
+            std::uninitialized_value_construct_n(items, capacity);
+        }
+
+        tee_chunk(tee_chunk const &) = delete;
+        tee_chunk & operator = (tee_chunk const &) = delete;
+
+        // Unlinks the following chunks nobody else holds one by one, so long chains don't recurse
+        ~tee_chunk()
+        {
+            auto chunk = std::move(next);
+            while(chunk && chunk.use_count() == 1)
+                chunk = std::move(chunk->next);
+            std::destroy_n(items, capacity);
+            alloc.deallocate(items, capacity);
+        }
+
+        // Chunk and its control block are allocated from the resource
+        static std::shared_ptr<tee_chunk> create(size_t capacity, std::pmr::memory_resource *resource)
+        {
+            return std::allocate_shared<tee_chunk>(std::pmr::polymorphic_allocator<tee_chunk>(resource), capacity, resource);
+        }
+    };
+
+    template<typename Src>
+    struct tee_state
+    {
+        using chunk = tee_chunk<typename Src::type>;
+
+        Src                        src;
+        size_t                     chunk_size;
+        std::pmr::memory_resource *resource;
+        std::mutex                 mutex;
+        std::shared_ptr<chunk>     tail;
+        bool                       done = false;
+
+        tee_state(Src const &src, size_t chunk_size, std::pmr::memory_resource *resource):
+            src(src),
+            chunk_size(chunk_size ? chunk_size : 256),
+            resource(resource),
+            tail(chunk::create(this->chunk_size, resource))
+        {}
+
+        // Appends the next upstream element to the tail chunk. Called with the mutex held.
+        bool pull()
+        {
+            if (done)
+                return false;
+
+            auto v = src.next();
+            if (!v)
+            {
+                done = true;
+                return false;
+            }
+
+            auto &t = *tail;
+            size_t const n = t.count.load(std::memory_order_relaxed);
+            t.items[n].emplace(std::move(*v));
+            if (n + 1 == t.capacity)
+            {
+                t.next = chunk::create(chunk_size, resource);
+                tail = t.next;
+            }
+            t.count.store(n + 1, std::memory_order_release);
+            return true;
+        }
+    };
+
+    // Branch of a tee. It holds the chunk it reads, so a chunk is released when the slowest branch has left it.
+    template<typename Src>
+    struct tee_fn
+    {
+        using type = typename Src::type;
+        using chunk = tee_chunk<type>;
+
+        std::shared_ptr<tee_state<Src>> state;
+        mutable std::shared_ptr<chunk>  current;
+        mutable size_t                  offset;
+
+        explicit tee_fn(std::shared_ptr<tee_state<Src>> const &state):
+            state(state),
+            current(state->tail),
+            offset(0)
+        {}
+
+        std::optional<type> operator()() const
+        {
+            for(;;)
+            {
+                if (offset < current->count.load(std::memory_order_acquire))
+                    return *current->items[offset++];
+
+                if (offset == current->capacity)
+                {
+                    current = current->next;
+                    offset = 0;
+                    continue;
+                }
+
+                // This branch is the first to need the element
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (offset == current->count.load(std::memory_order_relaxed) && !state->pull())
+                    return std::nullopt;
+            }
+        }
+    };
+}
@@ -0,0 +1,307 @@
+#pragma once
+#include <ostream>
+#include <cstdint>
+#include <cstddef>
+
+#ifdef PLUSAR_INSTRUMENT
+#   include <algorithm>
+#   include <atomic>
+#   include <chrono>
+#   include <memory>
+#   include <mutex>
+#   include <vector>
+#endif
+
+// Execution tracer exporting Chrome trace-event JSON (chrome://tracing, Perfetto).
+// Every thread appends events to its own buffer, so recording takes no locks. Spans are sampled
+// per outermost span: nested spans follow the decision of the span they are started in.
+// Without PLUSAR_INSTRUMENT all calls compile to nothing and the exported trace is empty.
+namespace plusar::trace
+{
+    // Nanoseconds since the tracer start, zero when nothing is traced
+    using timestamp = int64_t;
+
+#ifdef PLUSAR_INSTRUMENT
+    namespace internal
+    {
+        using clock = std::chrono::steady_clock;
+
+        struct event
+        {
+            char const *name;
+            char const *category;
+            timestamp   begin;
+            timestamp   end;
+        };
+
+        struct thread_buffer
+        {
+            uint32_t                 tid;
+            uint64_t                 generation;
+            size_t                   capacity;
+            std::unique_ptr<event[]> events;
+            std::atomic<size_t>      size{ 0 };
+            std::atomic<uint64_t>    dropped{ 0 };
+
+            thread_buffer(uint32_t tid, uint64_t generation, size_t capacity):
+                tid(tid),
+                generation(generation),
+                capacity(capacity),
+                events(new event[capacity])
+            {}
+
+            // Single writer; readers see events up to the published size
+            void push(event const &e)
+            {
+                size_t const n = size.load(std::memory_order_relaxed);
+                if (n == capacity)
+                {
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                events[n] = e;
+                size.store(n + 1, std::memory_order_release);
+            }
+        };
+
+        struct tracer
+        {
+            std::atomic<bool>                           active{ false };
+            std::atomic<uint64_t>                       generation{ 0 };
+            std::atomic<uint64_t>                       threshold{ 0 };    // sample when random < threshold
+            size_t                                      capacity = 0;
+            std::atomic<clock::rep>                     epoch{ 0 };         // ticks of clock, restarts may race with spans
+            std::mutex                                  mutex;
+            std::vector<std::shared_ptr<thread_buffer>> buffers;
+
+            static tracer & instance()
+            {
+                static tracer t;
+                return t;
+            }
+
+            std::shared_ptr<thread_buffer> attach()
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                auto buffer = std::make_shared<thread_buffer>(static_cast<uint32_t>(buffers.size()), generation.load(), capacity);
+                buffers.push_back(buffer);
+                return buffer;
+            }
+        };
+
+        struct thread_state
+        {
+            std::shared_ptr<thread_buffer> buffer;
+            uint64_t                       random = 0x9e3779b97f4a7c15ull ^ reinterpret_cast<uintptr_t>(this);
+            unsigned                       depth = 0;
+            bool                           sampled = false;
+
+            thread_buffer & current()
+            {
+                auto &t = tracer::instance();
+                if (!buffer || buffer->generation != t.generation.load(std::memory_order_relaxed))
+                    buffer = t.attach();
+                return *buffer;
+            }
+
+            bool sample()
+            {
+                random ^= random >> 12;
+                random ^= random << 25;
+                random ^= random >> 27;
+                uint64_t const threshold = tracer::instance().threshold.load(std::memory_order_relaxed);
+                return threshold == UINT64_MAX || random * 0x2545f4914f6cdd1dull < threshold;
+            }
+        };
+
+        inline thread_state & state()
+        {
+            thread_local thread_state s;
+            return s;
+        }
+
+        inline timestamp since_epoch()
+        {
+            clock::duration const since(clock::now().time_since_epoch().count() - tracer::instance().epoch.load(std::memory_order_relaxed));
+            auto const t = std::chrono::duration_cast<std::chrono::nanoseconds>(since).count();
+            return std::max<timestamp>(t, 1);
+        }
+
+        inline void write_string(std::ostream &os, char const *s)
+        {
+            os << '"';
+            for(; *s; ++s)
+            {
+                if (*s == '"' || *s == '\\')
+                    os << '\\';
+                os << *s;
+            }
+            os << '"';
+        }
+    }
+
+    inline bool active()
+    {
+        return internal::tracer::instance().active.load(std::memory_order_relaxed);
+    }
+
+    // Starts a new trace. sample_rate is the fraction of outermost spans recorded,
+    // events_per_thread bounds the memory of every thread; events beyond it are dropped.
+    inline void start(double sample_rate = 1.0, size_t events_per_thread = size_t{ 1 } << 16)
+    {
+        auto &t = internal::tracer::instance();
+        std::lock_guard<std::mutex> lock(t.mutex);
+
+        sample_rate = std::clamp(sample_rate, 0.0, 1.0);
+        t.threshold = sample_rate >= 1.0 ? UINT64_MAX : static_cast<uint64_t>(sample_rate * 18446744073709551615.0);
+        t.capacity = std::max<size_t>(events_per_thread, 1);
+        t.epoch = internal::clock::now().time_since_epoch().count();
+        t.buffers.clear();
+        ++t.generation;
+        t.active = true;
+    }
+
+    // Stops recording. The collected events are kept until the next start.
+    inline void stop()
+    {
+        internal::tracer::instance().active = false;
+    }
+
+    inline timestamp now()
+    {
+        return active() ? internal::since_epoch() : 0;
+    }
+
+    // Records an event which began at the given time and ends now. Sampled on its own.
+    inline void complete(char const *name, char const *category, timestamp begin)
+    {
+        if (!begin || !active())
+            return;
+        auto &s = internal::state();
+        if (s.depth ? s.sampled : s.sample())
+            s.current().push(internal::event{ name, category, begin, internal::since_epoch() });
+    }
+
+    // Scoped span
+    class span
+    {
+        char const *_name;
+        char const *_category;
+        timestamp   _begin = 0;
+
+        span(span const &) = delete;
+        span & operator = (span const &) = delete;
+
+    public:
+        span(char const *name, char const *category):
+            _name(name),
+            _category(category)
+        {
+            if (!active())
+                return;
+
+            auto &s = internal::state();
+            if (!s.depth++)
+                s.sampled = s.sample();
+            if (s.sampled)
+                _begin = internal::since_epoch();
+            else
+                _begin = -1;
+        }
+
+        ~span()
+        {
+            if (!_begin)
+                return;
+
+            auto &s = internal::state();
+            --s.depth;
+            if (_begin > 0)
+                s.current().push(internal::event{ _name, _category, _begin, internal::since_epoch() });
+        }
+    };
+
+    inline uint64_t dropped()
+    {
+        auto &t = internal::tracer::instance();
+        std::lock_guard<std::mutex> lock(t.mutex);
+
+        uint64_t n = 0;
+        for(auto const &b : t.buffers)
+            n += b->dropped.load(std::memory_order_relaxed);
+        return n;
+    }
+
+    // Chrome trace-event JSON of the events recorded so far
+    inline void write_json(std::ostream &os)
+    {
+        auto &t = internal::tracer::instance();
+        std::lock_guard<std::mutex> lock(t.mutex);
+
+        os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+
+        bool first = true;
+        auto const separator = [&first, &os]()
+        {
+            if (!first)
+                os << ",\n";
+            first = false;
+        };
+
+        for(auto const &b : t.buffers)
+        {
+            separator();
+            os << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << b->tid
+               << ",\"args\":{\"name\":\"plusar thread " << b->tid << "\"}}";
+
+            size_t const n = b->size.load(std::memory_order_acquire);
+            for(size_t i = 0; i < n; ++i)
+            {
+                auto const &e = b->events[i];
+                separator();
+                os << "{\"name\":";
+                internal::write_string(os, e.name);
+                os << ",\"cat\":";
+                internal::write_string(os, e.category);
+                os << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << b->tid
+                   << ",\"ts\":" << e.begin / 1000.0
+                   << ",\"dur\":" << (e.end - e.begin) / 1000.0 << '}';
+            }
+        }
+
+        os << "]}";
+    }
+#else
+    constexpr bool active()
+    {
+        return false;
+    }
+
+    inline void start(double = 1.0, size_t = 0) {}
+
+    inline void stop() {}
+
+    constexpr timestamp now()
+    {
+        return 0;
+    }
+
+    inline void complete(char const *, char const *, timestamp) {}
+
+    class span
+    {
+    public:
+        constexpr span(char const *, char const *) {}
+    };
+
+    inline uint64_t dropped()
+    {
+        return 0;
+    }
+
+    inline void write_json(std::ostream &os)
+    {
+        os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[]}";
+    }
+#endif
+}
@@ -0,0 +1,88 @@
+#include <plusar/any_stream.hpp>
+#include "catch.hpp"
+#include <functional>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace plusar;
+using namespace std;
+
+namespace
+{
+    any_stream<int> squares(int n)
+    {
+        return make_any_stream<int>(make_range(0, n).map([](int v) { return v * v; }));
+    }
+}
+
+TEST_CASE("Any stream keeps pipelines of different types", "[any_stream]") {
+    vector<any_stream<int>> pipelines;
+    pipelines.push_back(squares(4));
+    pipelines.push_back(make_any_stream<int>(make_stream({ 7, 8, 9 })));
+    pipelines.push_back(make_any_stream<int>(iota(0).filter([](int v) { return v % 2; }).take(3)));
+
+    vector<int> v;
+    for(auto const &p : pipelines)
+        p.collect(back_inserter(v));
+    REQUIRE(v == vector<int>{ 0, 1, 4, 9, 7, 8, 9, 1, 3, 5 });
+}
+
+TEST_CASE("Any stream composes with operators", "[any_stream]") {
+    REQUIRE(squares(10)
+                .filter([](int v) { return v % 2 == 0; })
+                .reduce(0, std::plus<>())
+                .collect() == 120);
+
+    auto s = squares(10);
+    REQUIRE(s.size_hint() == 10);
+    REQUIRE(s.next() == 0);
+    REQUIRE(s.size_hint() == 9);
+    REQUIRE(s.advance(3) == 3);
+    REQUIRE(s.next() == 16);
+
+    int out[10] = {};
+    REQUIRE(s.next_batch(out, 10) == 5);
+    REQUIRE(out[0] == 25);
+    REQUIRE(out[4] == 81);
+    REQUIRE(!s.next());
+}
+
+TEST_CASE("Any stream copies are independent", "[any_stream]") {
+    auto a = squares(5);
+    a.next();
+    auto b = a;
+    REQUIRE(a.next() == 1);
+    REQUIRE(a.next() == 4);
+    REQUIRE(b.next() == 1);
+    REQUIRE(b.count() == 3);
+    REQUIRE(a.count() == 2);
+}
+
+TEST_CASE("Any stream storage", "[any_stream]") {
+    auto small = make_any_stream<int>(make_range(0, 3));
+    REQUIRE(small.next() == 0);
+
+    string const tail(100, 'x');
+    auto large = make_any_stream<size_t>(make_range(size_t{ 0 }, size_t{ 3 })
+                                            .map([tail, pad = array<char, 128>{}](size_t v) { return v + tail.size() + pad.size(); }));
+    auto moved = std::move(large);
+    REQUIRE(moved.next() == 228);
+    REQUIRE(moved.count() == 2);
+
+    // The moved from stream is empty, and so are its copies
+    auto copy = large;
+    REQUIRE(copy.size_hint() == 0u);
+    REQUIRE(copy.next() == nullopt);
+    REQUIRE(large.count() == 0);
+}
+
+TEST_CASE("Any streams move into vectors without copies", "[any_stream]") {
+    STATIC_REQUIRE(is_nothrow_move_constructible<any_stream<int>>::value);
+
+    vector<any_stream<int>> v;
+    for(int i = 0; i < 20; ++i)
+        v.push_back(make_any_stream<int>(make_range(0, i)));
+    for(int i = 0; i < 20; ++i)
+        REQUIRE(v[i].count() == static_cast<size_t>(i));
+}
@@ -0,0 +1,142 @@
+#include <plusar/async.hpp>
+#include "catch.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+#include <iterator>
+#include <stdexcept>
+
+using namespace plusar;
+using namespace std;
+
+TEST_CASE("Async map keeps order", "[async]") {
+    vector<int> v;
+    make_range(0, 50)
+        .async_map([](int t)
+        {
+            return std::async(launch::async, [t]()
+            {
+                this_thread::sleep_for(chrono::microseconds((50 - t) * 20));
+                return t * 2;
+            });
+        }, 8)
+        .collect(back_inserter(v));
+
+    REQUIRE(v.size() == 50);
+    for(int i = 0; i < 50; ++i)
+        REQUIRE(v[i] == i * 2);
+}
+
+TEST_CASE("Async map bounds operations in flight", "[async]") {
+    atomic<int> running{ 0 };
+    atomic<int> peak{ 0 };
+
+    auto fn = [&](int t)
+    {
+        int now = ++running;
+        int prev = peak;
+        while(now > prev && !peak.compare_exchange_weak(prev, now));
+
+        return std::async(launch::async, [&running, t]()
+        {
+            this_thread::sleep_for(chrono::microseconds(200));
+            --running;
+            return t;
+        });
+    };
+
+    vector<int> v;
+    make_range(0, 40).async_map_unordered(fn, 4).collect(back_inserter(v));
+
+    sort(v.begin(), v.end());
+    REQUIRE(v.size() == 40);
+    REQUIRE(v.front() == 0);
+    REQUIRE(v.back() == 39);
+    REQUIRE(peak <= 4);
+}
+
+TEST_CASE("Async map unordered emits futures as they complete", "[async]") {
+    auto s = make_range(0, 2).async_map_unordered([](int t)
+    {
+        return std::async(launch::async, [t]()
+        {
+            this_thread::sleep_for(chrono::milliseconds(t ? 1 : 200));
+            return t;
+        });
+    }, 2);
+
+    auto const start = chrono::steady_clock::now();
+    REQUIRE(s.next() == 1);
+    REQUIRE(chrono::steady_clock::now() - start < chrono::milliseconds(150));
+    REQUIRE(s.next() == 0);
+    REQUIRE(!s.next());
+}
+
+TEST_CASE("Async map with completion callback", "[async]") {
+    vector<thread> threads;
+    vector<int> v;
+
+    make_range(0, 10)
+        .async_map<int>([&threads](int t, completion<int> done)
+        {
+            threads.emplace_back([t, done]() { done(t + 100); });
+        }, 3)
+        .collect(back_inserter(v));
+
+    for(auto &t : threads)
+        t.join();
+
+    REQUIRE(v.size() == 10);
+    for(int i = 0; i < 10; ++i)
+        REQUIRE(v[i] == i + 100);
+}
+
+TEST_CASE("Async map timeout", "[async]") {
+    vector<completion<int>> stalled;
+
+    auto s = make_range(0, 3)
+                .async_map<int>([&stalled](int, completion<int> done) { stalled.push_back(done); }, 2, chrono::milliseconds(5));
+    REQUIRE_THROWS_AS(s.next(), async_timeout);
+
+    auto u = make_range(0, 3)
+                .async_map_unordered<int>([&stalled](int t, completion<int> done)
+                {
+                    if (t)
+                        done(t);
+                    else
+                        stalled.push_back(done);
+                }, 3, chrono::milliseconds(5));
+    REQUIRE(u.next() == 1);
+    REQUIRE(u.next() == 2);
+    REQUIRE_THROWS_AS(u.next(), async_timeout);
+}
+
+TEST_CASE("Async map doesn't wait for timed out tasks", "[async]") {
+    auto slow = [](int t) { return std::async(launch::async, [t]() { this_thread::sleep_for(chrono::milliseconds(500)); return t; }); };
+
+    auto const start = chrono::steady_clock::now();
+    REQUIRE_THROWS_AS(make_range(0, 2).async_map(slow, 2, chrono::milliseconds(10)).next(), async_timeout);
+    REQUIRE_THROWS_AS(make_range(0, 2).async_map_unordered(slow, 2, chrono::milliseconds(10)).next(), async_timeout);
+    REQUIRE(chrono::steady_clock::now() - start < chrono::milliseconds(400));
+}
+
+TEST_CASE("Async map without a practical timeout", "[async]") {
+    auto s = make_range(0, 4).async_map_unordered<int>([](int t, completion<int> done)
+    {
+        std::thread([t, done]() { this_thread::sleep_for(chrono::milliseconds(4 - t)); done(t); }).detach();
+    }, 4, chrono::nanoseconds::max());
+
+    vector<int> v;
+    s.collect(back_inserter(v));
+    sort(v.begin(), v.end());
+    REQUIRE(v == vector<int>{ 0, 1, 2, 3 });
+}
+
+TEST_CASE("Async map failure", "[async]") {
+    auto s = make_range(0, 3)
+                .async_map<int>([](int, completion<int> done) { done.fail(make_exception_ptr(runtime_error("lookup failed"))); }, 2);
+    REQUIRE_THROWS_AS(s.next(), runtime_error);
+}
@@ -0,0 +1,92 @@
+#include <plusar/cache.hpp>
+#include <plusar/parallel.hpp>
+#include "catch.hpp"
+#include <functional>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace plusar;
+using namespace std;
+
+TEST_CASE("Cache evaluates the source once", "[cache]") {
+    int decoded = 0;
+    auto c = make_range(0, 10000)
+                .map([&decoded](int v) { ++decoded; return v * 3; })
+                .cache();
+
+    REQUIRE(c.replay().take(5).sum() == 30);
+    REQUIRE(decoded == 5);
+
+    REQUIRE(c.replay().sum() == 149985000);
+    REQUIRE(c.replay().count() == 10000);
+    REQUIRE(c.size() == 10000);
+    REQUIRE(decoded == 10000);
+}
+
+TEST_CASE("Cache replays are random access with exact size", "[cache]") {
+    auto c = make_stream(vector<string>{ "a", "b", "c", "d", "e" }).filter([](string const &s) { return s != "c"; }).cache();
+
+    // The size of the filtered source is known once it's stored
+    auto r = c.replay();
+    REQUIRE(r.size_hint() == nullopt);
+    REQUIRE(c.size() == 4);
+    REQUIRE(r.size_hint() == 4);
+    REQUIRE(r.at(2) == "d");
+    REQUIRE(!r.at(4));
+    REQUIRE(r.next() == "a");
+    REQUIRE(r.advance(2) == 2);
+    REQUIRE(r.size_hint() == 1);
+    REQUIRE(r.at(0) == "e");
+    REQUIRE(r.next() == "e");
+    REQUIRE(!r.next());
+
+    vector<string> all;
+    c.replay().collect(back_inserter(all));
+    REQUIRE(all == vector<string>{ "a", "b", "d", "e" });
+}
+
+TEST_CASE("Cache replays in batches and in parallel", "[cache]") {
+    auto c = make_range<int64_t>(0, 100000).cache();
+
+    vector<int64_t> batch(30000);
+    auto r = c.replay();
+    REQUIRE(r.next_batch(batch.data(), batch.size()) == 30000);
+    REQUIRE(batch[29999] == 29999);
+    REQUIRE(r.next() == 30000);
+
+    REQUIRE(parallel_reduce(c.replay(), int64_t{ 0 }, std::plus<>(), std::plus<>()) == int64_t{ 99999 } * 100000 / 2);
+}
+
+TEST_CASE("Cache of an endless stream", "[cache]") {
+    auto c = iota(0).cache();
+    auto r = c.replay();
+    REQUIRE(r.size_hint() == SIZE_MAX);
+    REQUIRE(r.at(100000) == 100000);
+    REQUIRE(c.replay().skip(5).first() == 5);
+}
+
+TEST_CASE("Cache of an endless source of unknown size", "[cache]") {
+    int n = 0;
+    auto c = make_stream([&n]() { return make_optional(n++); }).cache();
+
+    auto r = c.replay();
+    REQUIRE(r.size_hint() == nullopt);
+    REQUIRE(!r.try_split());
+    REQUIRE(r.take(5).count() == 5);
+    REQUIRE(n == 5);
+
+    REQUIRE(c.replay().take(8).sum() == 28);
+    REQUIRE(n == 8);
+}
+
+#ifdef PLUSAR_HAS_MMAP
+TEST_CASE("Cache spills to a temporary file above the memory limit", "[cache]") {
+    auto c = make_range<uint64_t>(0, 1000000).cache(256 * 1024);
+
+    REQUIRE(c.replay().sum() == uint64_t{ 999999 } * 1000000 / 2);
+    REQUIRE(c.bytes_in_memory() <= 256 * 1024);
+    REQUIRE(c.replay().at(999999) == 999999);
+    REQUIRE(c.replay().skip(500000).first() == 500000);
+}
+#endif
@@ -0,0 +1,140 @@
+#include <plusar/channel.hpp>
+#include <plusar/async.hpp>
+#include "catch.hpp"
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+#include <iterator>
+
+using namespace plusar;
+using namespace std;
+
+TEST_CASE("Channel delivers pushed elements until closed", "[channel]") {
+    channel<int> ch(4);
+    thread producer([ch]()
+    {
+        for(int i = 0; i < 100; ++i)
+            ch.push(i);
+        ch.close();
+    });
+
+    REQUIRE(ch.receive().sum() == 4950);
+    producer.join();
+    REQUIRE(!ch.push(1));
+}
+
+TEST_CASE("Channel waits until a deadline", "[channel]") {
+    channel<int> ch;
+    auto s = ch.receive();
+
+    optional<int> v;
+    REQUIRE(s.next_until(v, chrono::steady_clock::now() + chrono::milliseconds(1)) == pull_status::timeout);
+    REQUIRE(ch.try_push(7));
+    REQUIRE(s.map([](int x) { return x * 2; }).next_until(v, chrono::steady_clock::now()) == pull_status::ready);
+    REQUIRE(v == 14);
+    ch.close();
+    REQUIRE(s.next_until(v, chrono::steady_clock::time_point::max()) == pull_status::end);
+}
+
+TEST_CASE("Batch by size", "[channel][batch]") {
+    vector<vector<int>> v;
+    make_range(0, 10).batch(4, chrono::seconds(10)).collect(back_inserter(v));
+    REQUIRE(v == vector<vector<int>>{ { 0, 1, 2, 3 }, { 4, 5, 6, 7 }, { 8, 9 } });
+}
+
+TEST_CASE("Batch deadline fires while the channel is idle", "[channel][batch]") {
+    channel<int> ch;
+    auto batches = ch.receive()
+                     .filter([](int v) { return v % 2 == 0; })
+                     .batch(100, chrono::milliseconds(20));
+
+    for(int i = 0; i < 6; ++i)
+        ch.push(i);
+
+    auto const start = chrono::steady_clock::now();
+    auto first = batches.next();
+    auto const waited = chrono::steady_clock::now() - start;
+
+    REQUIRE(first == vector<int>{ 0, 2, 4 });
+    REQUIRE(waited >= chrono::milliseconds(20));
+    REQUIRE(waited < chrono::seconds(5));
+
+    ch.push(6);
+    ch.close();
+    REQUIRE(batches.next() == vector<int>{ 6 });
+    REQUIRE(!batches.next());
+}
+
+TEST_CASE("Batch deadline fires behind an async boundary", "[channel][batch][async]") {
+    channel<int> ch;
+    auto batches = ch.receive()
+                     .async_map([](int v) { return std::async(launch::deferred, [v]() { return v * 10; }); }, 4)
+                     .batch(100, chrono::milliseconds(10));
+
+    for(int i = 1; i <= 3; ++i)
+        ch.push(i);
+
+    REQUIRE(batches.next() == vector<int>{ 10, 20, 30 });
+
+    thread producer([ch]()
+    {
+        for(int i = 0; i < 250; ++i)
+            ch.push(i);
+        ch.close();
+    });
+
+    size_t total = 0;
+    for(auto b = batches.next(); b; b = batches.next())
+    {
+        REQUIRE(b->size() <= 100);
+        total += b->size();
+    }
+    producer.join();
+    REQUIRE(total == 250);
+}
+
+TEST_CASE("Async map starts elements arriving while it waits", "[channel][async]") {
+    channel<int> ch;
+    vector<thread> workers;
+    auto s = ch.receive().async_map_unordered<int>([&workers](int v, completion<int> done)
+    {
+        workers.emplace_back([v, done]()
+        {
+            this_thread::sleep_for(chrono::milliseconds(v ? 0 : 300));
+            done(v);
+        });
+    }, 2);
+
+    ch.push(0);
+    thread producer([ch]()
+    {
+        this_thread::sleep_for(chrono::milliseconds(20));
+        ch.push(1);
+    });
+
+    auto const start = chrono::steady_clock::now();
+    optional<int> v;
+    REQUIRE(s.next_until(v, start + chrono::seconds(2)) == pull_status::ready);
+    REQUIRE(v == 1);
+    REQUIRE(chrono::steady_clock::now() - start < chrono::milliseconds(250));
+
+    producer.join();
+    for(auto &w : workers)
+        w.join();
+}
+
+TEST_CASE("Batch checks the deadline of plain sources after every element", "[batch]") {
+    auto batches = make_range(0, 20)
+                     .map([](int v) { this_thread::sleep_for(chrono::milliseconds(2)); return v; })
+                     .batch(20, chrono::milliseconds(1));
+
+    size_t count = 0, total = 0;
+    for(auto b = batches.next(); b; b = batches.next())
+    {
+        ++count;
+        total += b->size();
+    }
+    REQUIRE(total == 20);
+    REQUIRE(count > 1);
+}
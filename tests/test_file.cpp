@@ -0,0 +1,79 @@
+#include <plusar/file.hpp>
+#include "catch.hpp"
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <iterator>
+
+using namespace plusar;
+using namespace std;
+
+namespace
+{
+    struct temp_file
+    {
+        string path = "plusar_test_" + to_string(reinterpret_cast<uintptr_t>(this)) + ".tmp";
+
+        explicit temp_file(string const &content)
+        {
+            ofstream(path, ios::binary) << content;
+        }
+
+        ~temp_file()
+        {
+            remove(path.c_str());
+        }
+    };
+}
+
+TEST_CASE("Line file stream", "[file]") {
+    temp_file f("first\nsecond\r\n\nlast");
+    vector<string> lines;
+    make_line_stream(f.path).collect(back_inserter(lines));
+
+    REQUIRE(lines == vector<string>{ "first", "second", "", "last" });
+}
+
+TEST_CASE("Split line file stream", "[file][split]") {
+    string content;
+    for(int i = 0; i < 1000; ++i)
+        content += to_string(i) + "\n";
+    temp_file f(content);
+
+    auto s = make_line_stream(f.path);
+    REQUIRE(s.estimated_size() > 500);
+    REQUIRE(s.estimated_size() < 2000);
+
+    auto prefix = s.try_split();
+    REQUIRE(prefix);
+
+    vector<string> lines;
+    prefix->collect(back_inserter(lines));
+    size_t const head = lines.size();
+    s.collect(back_inserter(lines));
+
+    REQUIRE(head > 0);
+    REQUIRE(head < 1000);
+    REQUIRE(lines.size() == 1000);
+    for(int i = 0; i < 1000; ++i)
+        REQUIRE(lines[i] == to_string(i));
+}
+
+TEST_CASE("Record file stream", "[file][split]") {
+    vector<int> values{ 1, 2, 3, 4, 5, 6, 7 };
+    temp_file f(string(reinterpret_cast<char const *>(values.data()), values.size() * sizeof(int)));
+
+    auto s = make_record_stream<int>(f.path);
+    REQUIRE(s.size_hint() == 7u);
+    REQUIRE(s.at(6) == 7);
+
+    auto prefix = s.try_split();
+    REQUIRE(prefix);
+    REQUIRE(prefix->sum() == 6);
+    REQUIRE(s.sum() == 22);
+}
+
+TEST_CASE("Missing file", "[file]") {
+    REQUIRE_THROWS_AS(make_line_stream("plusar_missing.tmp"), system_error);
+}
@@ -0,0 +1,108 @@
+#include <plusar/generate.hpp>
+#include "catch.hpp"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace plusar;
+using namespace std;
+
+namespace
+{
+    template<typename S>
+    auto drain(S const &s)
+    {
+        vector<typename S::type> v;
+        for(auto e = s.next(); e; e = s.next())
+            v.push_back(*e);
+        return v;
+    }
+}
+
+TEST_CASE("Generators are reproducible", "[generate]") {
+    REQUIRE(drain(gen::uniform(1000, 10000, 42)) == drain(gen::uniform(1000, 10000, 42)));
+    REQUIRE(drain(gen::uniform(1000, 10000, 42)) != drain(gen::uniform(1000, 10000, 43)));
+    REQUIRE(drain(gen::poisson(1000, 100, 7)) == drain(gen::poisson(1000, 100, 7)));
+
+    auto keys = drain(gen::uniform(10, 10000));
+    REQUIRE(keys.size() == 10000);
+    REQUIRE(*max_element(keys.begin(), keys.end()) == 9);
+    REQUIRE(*min_element(keys.begin(), keys.end()) == 0);
+}
+
+TEST_CASE("Generators produce the same values when split or advanced", "[generate]") {
+    auto const expected = drain(gen::zipf(100, 1.1, 20000, 5));
+
+    auto suffix = gen::zipf(100, 1.1, 20000, 5);
+    vector<uint64_t> parts;
+    while(auto prefix = suffix.try_split())
+    {
+        auto v = drain(*prefix);
+        parts.insert(parts.end(), v.begin(), v.end());
+    }
+    auto v = drain(suffix);
+    parts.insert(parts.end(), v.begin(), v.end());
+    REQUIRE(parts == expected);
+
+    auto s = gen::zipf(100, 1.1, 20000, 5);
+    s.next();
+    REQUIRE(s.advance(5000) == 5000);
+    REQUIRE(s.size_hint() == 14999);
+    REQUIRE(*s.next() == expected[5001]);
+}
+
+TEST_CASE("Zipf keys are skewed", "[generate]") {
+    vector<size_t> counts(1000);
+    for(auto k : drain(gen::zipf(1000, 1.0, 200000, 1)))
+        ++counts[k];
+
+    REQUIRE(is_sorted(counts.begin(), counts.begin() + 4, greater<>()));
+    REQUIRE(static_cast<double>(counts[0]) / counts[1] == Approx(2).epsilon(0.05));
+    REQUIRE(static_cast<double>(counts[0]) / counts[9] == Approx(10).epsilon(0.1));
+}
+
+TEST_CASE("Payload sizes", "[generate]") {
+    for(auto const &p : drain(gen::payload(3, 17, 1000)))
+    {
+        REQUIRE(p.size() >= 3);
+        REQUIRE(p.size() <= 17);
+        REQUIRE(all_of(p.begin(), p.end(), [](char c) { return c >= 'a' && c <= 'z'; }));
+    }
+}
+
+TEST_CASE("Arrival processes keep the requested rate", "[generate]") {
+    auto poisson = drain(gen::poisson(1e6, 100000, 3, 1000));
+    REQUIRE(is_sorted(poisson.begin(), poisson.end()));
+    REQUIRE(poisson.front() >= 1000);
+    REQUIRE((poisson.back() - 1000) / 1e5 == Approx(1000).epsilon(0.02));
+
+    auto bursty = drain(gen::bursty(1e6, 1e8, 50, 100000, 3));
+    REQUIRE(is_sorted(bursty.begin(), bursty.end()));
+    REQUIRE(bursty.back() / 1e5 == Approx(1000).epsilon(0.1));
+
+    // most gaps are within bursts, far shorter than the mean gap
+    size_t short_gaps = 0;
+    for(size_t i = 1; i < bursty.size(); ++i)
+        short_gaps += bursty[i] - bursty[i - 1] < 100;
+    REQUIRE(short_gaps > bursty.size() * 0.9);
+}
+
+TEST_CASE("Generator rng splits into independent sequences", "[generate]") {
+    gen::rng a(1);
+    gen::rng b = a;
+    gen::rng c = a.split();
+    REQUIRE(b() == c());
+    REQUIRE(a() != b());
+}
+
+TEST_CASE("Bounded values are unbiased", "[generate]") {
+    // Multiply-shift without rejection maps two draws to every value divisible by 3 below 3 * 2^62 and one
+    // draw to the others, so half of the values would be divisible by 3
+    uint64_t const n = uint64_t{ 3 } << 62;
+    gen::rng r(5);
+    size_t divisible = 0;
+    for(int i = 0; i < 30000; ++i)
+        divisible += r.below(n) % 3 == 0;
+    REQUIRE(divisible > 9500);
+    REQUIRE(divisible < 10500);
+}
@@ -0,0 +1,116 @@
+#include <plusar/histogram.hpp>
+#include "catch.hpp"
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace plusar;
+using namespace std;
+
+TEST_CASE("Histogram counts small values exactly", "[histogram]") {
+    latency_histogram h;
+    for(uint64_t v = 1; v <= 100; ++v)
+        h.record(v);
+
+    REQUIRE(h.count() == 100);
+    REQUIRE(h.min() == 1);
+    REQUIRE(h.max() == 100);
+    REQUIRE(h.mean() == Approx(50.5));
+    REQUIRE(h.percentile(50) == 50);
+    REQUIRE(h.percentile(99) == 99);
+    REQUIRE(h.percentile(100) == 100);
+}
+
+TEST_CASE("Histogram precision of large values", "[histogram]") {
+    latency_histogram h;
+    for(uint64_t v = 1; v <= 100000; ++v)
+        h.record(v * 1000);
+
+    for(double p : { 10.0, 50.0, 90.0, 99.0, 99.9 })
+    {
+        double const expected = p / 100 * 100000 * 1000;
+        REQUIRE(static_cast<double>(h.percentile(p)) == Approx(expected).epsilon(0.01));
+    }
+
+    h.record(UINT64_MAX);
+    REQUIRE(h.percentile(100) == UINT64_MAX);
+}
+
+TEST_CASE("Concurrent recording", "[histogram]") {
+    latency_histogram h;
+    vector<thread> threads;
+    for(int t = 0; t < 4; ++t)
+        threads.emplace_back([&h, t]()
+        {
+            for(uint64_t v = 0; v < 10000; ++v)
+                h.record(v + t);
+        });
+    for(auto &t : threads)
+        t.join();
+
+    REQUIRE(h.count() == 40000);
+    REQUIRE(h.min() == 0);
+    REQUIRE(h.max() == 10002);
+}
+
+TEST_CASE("Merge and export histograms", "[histogram]") {
+    latency_histogram a, b;
+    a.record(10);
+    b.record(20, 3);
+    a.merge(b);
+
+    REQUIRE(a.count() == 4);
+    REQUIRE(a.max() == 20);
+    REQUIRE(a.percentile(25) == 10);
+
+    ostringstream os;
+    a.to_json(os);
+    REQUIRE(os.str().find("\"count\":4") != string::npos);
+    REQUIRE(os.str().find("[20,3]") != string::npos);
+
+    a.reset();
+    REQUIRE(a.count() == 0);
+    REQUIRE(a.percentile(99) == 0);
+}
+
+TEST_CASE("Record pipeline latency", "[histogram]") {
+    latency_histogram h;
+
+    auto n = make_range(0, 20)
+                .mark_ingest()
+                .map([](int t) { this_thread::sleep_for(chrono::microseconds(200)); return t; })
+                .filter([](int t) { return t % 2 == 0; })
+                .record_latency(h)
+                .count();
+
+    REQUIRE(n == 10);
+    REQUIRE(h.count() == 10);
+    REQUIRE(h.min() >= 200000);
+    REQUIRE(h.percentile(50) >= 200000);
+}
+
+TEST_CASE("Latency of pipelines pulled on the same thread", "[histogram]") {
+    latency_histogram fast, slow;
+
+    auto a = make_range(0, 10).mark_ingest().record_latency(fast);
+    auto b = make_range(0, 10)
+                .mark_ingest()
+                .map([](int t) { this_thread::sleep_for(chrono::microseconds(500)); return t; })
+                .filter([](int t) { return t < 5; })
+                .record_latency(slow);
+
+    for(int i = 0; i < 10; ++i)
+    {
+        a.next();
+        b.next();
+    }
+
+    REQUIRE(fast.count() == 10);
+    REQUIRE(fast.max() < 500000);
+    REQUIRE(slow.count() == 5);
+    REQUIRE(slow.min() >= 500000);
+    REQUIRE(a.next() == nullopt);
+    REQUIRE(fast.count() == 10);
+}
@@ -0,0 +1,111 @@
+#include <plusar/stream.hpp>
+#include <plusar/instrument.hpp>
+#include "catch.hpp"
+#include <sstream>
+#include <string>
+
+using namespace plusar;
+using namespace std;
+
+static_assert(instrument::enabled, "this test is built with PLUSAR_INSTRUMENT");
+
+namespace
+{
+    instrument::stage_report stage(string const &name)
+    {
+        for(auto const &s : instrument::report())
+            if (s.name == name)
+                return s;
+        FAIL("stage " << name << " isn't reported");
+        return {};
+    }
+}
+
+TEST_CASE("Stage counters", "[instrument]") {
+    instrument::reset();
+
+    REQUIRE(make_range(0, 100)
+                .map([](int t) { return t + 0; })
+                .filter([](int t) { return t % 2 == 0; })
+                .take(10)
+                .sum() == 90);
+
+    auto range = stage("range");
+    REQUIRE(range.pulls == 19);
+    REQUIRE(range.out == 19);
+
+    auto map = stage("map");
+    REQUIRE(map.in == 19);
+    REQUIRE(map.out == 19);
+
+    auto filter = stage("filter");
+    REQUIRE(filter.pulls == 10);
+    REQUIRE(filter.in == 19);
+    REQUIRE(filter.out == 10);
+
+    auto take = stage("take");
+    REQUIRE(take.pulls == 11);
+    REQUIRE(take.in == 10);
+    REQUIRE(take.out == 10);
+
+    auto reduce = stage("reduce");
+    REQUIRE(reduce.in == 10);
+    REQUIRE(reduce.out == 1);
+    REQUIRE(reduce.total_ms >= reduce.self_ms);
+    REQUIRE(reduce.total_ms >= take.total_ms);
+
+    REQUIRE(range.id < map.id);
+    REQUIRE(map.id < filter.id);
+}
+
+TEST_CASE("Fused stages are reported once", "[instrument]") {
+    instrument::reset();
+
+    make_stream({ 1, 2, 3 })
+        .map([](int t) { return t * 2; })
+        .map([](int t) { return t + 1; })
+        .sum();
+
+    size_t maps = 0;
+    for(auto const &s : instrument::report())
+        maps += s.name == "map";
+    REQUIRE(maps == 1);
+    REQUIRE(stage("array").out == 3);
+}
+
+TEST_CASE("Split stages share counters", "[instrument]") {
+    instrument::reset();
+
+    auto s = make_range(0, 10).map([](int t) { return t; });
+    auto prefix = s.try_split();
+    REQUIRE(prefix);
+    REQUIRE(prefix->count() + s.count() == 10);
+
+    auto counted = make_range(0, 10).map([](int t) { return t; });
+    auto part = counted.try_split();
+    part->sum();
+    counted.sum();
+    REQUIRE(stage("map").out == 10);
+}
+
+TEST_CASE("Print stage report", "[instrument]") {
+    instrument::reset();
+    make_stream({ 1, 2, 3 }).filter([](int t) { return t > 1; }).count();
+
+    ostringstream os;
+    instrument::print_report(os);
+    REQUIRE(os.str().find("filter") != string::npos);
+    REQUIRE(os.str().find("array") != string::npos);
+}
+
+TEST_CASE("Inner streams share counters", "[instrument]") {
+    instrument::reset();
+
+    REQUIRE(make_range(0, 1000)
+                .map([](int t) { return make_range(0, t % 3); })
+                .flatten()
+                .count() == 999);
+
+    REQUIRE(instrument::report().size() <= 4);
+    REQUIRE(stage("range").out == 1000 + 999);
+}
@@ -0,0 +1,100 @@
+#include <plusar/memory.hpp>
+#include <plusar/tee.hpp>
+#include <plusar/cache.hpp>
+#include "catch.hpp"
+#include <memory_resource>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace plusar;
+using namespace std;
+
+namespace
+{
+    // Counts the allocations passed to the default resource
+    struct counting_resource : pmr::memory_resource
+    {
+        size_t allocations = 0;
+        size_t live = 0;
+
+        void * do_allocate(size_t bytes, size_t alignment) override
+        {
+            ++allocations;
+            ++live;
+            return pmr::new_delete_resource()->allocate(bytes, alignment);
+        }
+
+        void do_deallocate(void *p, size_t bytes, size_t alignment) override
+        {
+            --live;
+            pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+        }
+
+        bool do_is_equal(pmr::memory_resource const &other) const noexcept override
+        {
+            return this == &other;
+        }
+    };
+}
+
+TEST_CASE("Arena reuses its blocks after reset", "[memory]") {
+    counting_resource upstream;
+    {
+        arena a(1024, &upstream);
+
+        for(int window = 0; window < 10; ++window)
+        {
+            pmr::vector<int64_t> values(&a);
+            for(int64_t i = 0; i < 10000; ++i)
+                values.push_back(i);
+            REQUIRE(values[9999] == 9999);
+            a.reset();
+            if (window == 0)
+                upstream.allocations = 0;
+        }
+
+        REQUIRE(upstream.allocations == 0);
+        REQUIRE(a.bytes_reserved() >= 10000 * sizeof(int64_t));
+    }
+    REQUIRE(upstream.live == 0);
+}
+
+TEST_CASE("Arena aligns allocations", "[memory]") {
+    arena a(64);
+    for(size_t alignment : { 1, 8, 16, 64, 256 })
+    {
+        void *p = a.allocate(3, alignment);
+        REQUIRE(reinterpret_cast<uintptr_t>(p) % alignment == 0);
+    }
+
+    void *large = a.allocate(100000, 16);
+    REQUIRE(large);
+    a.release();
+    REQUIRE(a.bytes_reserved() == 0);
+}
+
+TEST_CASE("Tee and cache allocate chunks from the resource", "[memory]") {
+    counting_resource resource;
+    {
+        auto branches = make_range(0, 1000).map([](int v) { return to_string(v); }).tee(2, 16, &resource);
+        REQUIRE(branches[0].count() == 1000);
+        REQUIRE(branches[1].count() == 1000);
+        REQUIRE(resource.allocations >= 1000 / 16);
+    }
+    REQUIRE(resource.live == 0);
+
+    resource.allocations = 0;
+    {
+        auto c = make_range(0, 10000).cache(SIZE_MAX, &resource);
+        REQUIRE(c.replay().sum() == 49995000);
+        REQUIRE(resource.allocations == 3);
+    }
+    REQUIRE(resource.live == 0);
+}
+
+TEST_CASE("Stages allocate from the thread local pool", "[memory]") {
+    auto branches = make_range(0, 10000).tee(2, 64, thread_local_pool());
+    REQUIRE(branches[0].sum() == 49995000);
+    REQUIRE(branches[1].sum() == 49995000);
+}
@@ -0,0 +1,93 @@
+#include <plusar/merge.hpp>
+#include <plusar/any_stream.hpp>
+#include "catch.hpp"
+#include <functional>
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <string>
+#include <vector>
+
+using namespace plusar;
+using namespace std;
+
+TEST_CASE("Merge a fixed number of sorted streams", "[merge]") {
+    auto s = merge_sorted(make_stream(vector<int>{ 1, 4, 7 }),
+                          make_range(0, 10, 3),
+                          make_stream(vector<int>{ 2, 2, 8, 9 }).map([](int v) { return v; }));
+
+    REQUIRE(s.size_hint() == 11u);
+
+    vector<int> v;
+    s.collect(back_inserter(v));
+    REQUIRE(v == vector<int>{ 0, 1, 2, 2, 3, 4, 6, 7, 8, 9, 9 });
+}
+
+TEST_CASE("Merge with a comparator", "[merge]") {
+    auto s = merge_sorted(make_stream(vector<string>{ "c", "b" }),
+                          make_stream(vector<string>{ "d", "a" }),
+                          std::greater<>());
+
+    vector<string> v;
+    s.collect(back_inserter(v));
+    REQUIRE(v == vector<string>{ "d", "c", "b", "a" });
+}
+
+TEST_CASE("Merge keeps the input order of equal elements", "[merge]") {
+    using event = pair<int, int>;       // timestamp, shard
+    auto by_time = [](event const &a, event const &b) { return a.first < b.first; };
+
+    vector<any_stream<event>> shards;
+    for(int shard = 0; shard < 5; ++shard)
+        shards.push_back(make_any_stream<event>(make_range(0, 100).map([shard](int t) { return event{ t / 3, shard }; })));
+
+    vector<event> v;
+    merge_sorted(shards, by_time).collect(back_inserter(v));
+
+    REQUIRE(v.size() == 500);
+    REQUIRE(is_sorted(v.begin(), v.end()));
+}
+
+TEST_CASE("Merge a number of streams known at run time", "[merge]") {
+    for(size_t k : { 0, 1, 2, 3, 7, 16, 33 })
+    {
+        vector<decltype(make_range(size_t{ 0 }, size_t{ 0 }, size_t{ 1 }))> inputs;
+        for(size_t i = 0; i < k; ++i)
+            inputs.push_back(make_range(i, size_t{ 1000 }, k + i % 3));
+
+        vector<size_t> expected;
+        for(size_t i = 0; i < k; ++i)
+            for(size_t v = i; v < 1000; v += k + i % 3)
+                expected.push_back(v);
+        sort(expected.begin(), expected.end());
+
+        auto s = merge_sorted(inputs);
+        REQUIRE(s.size_hint() == expected.size());
+
+        vector<size_t> v;
+        s.collect(back_inserter(v));
+        REQUIRE(v == expected);
+    }
+}
+
+TEST_CASE("Copies of a merge continue independently", "[merge]") {
+    auto s = merge_sorted(make_range(0, 100, 2), make_range(1, 100, 2));
+    REQUIRE(s.next() == 0);
+
+    auto copy = s;
+    REQUIRE(copy.take(5).sum() == 1 + 2 + 3 + 4 + 5);
+    REQUIRE(s.next() == 1);
+    REQUIRE(s.count() == 98);
+}
+
+TEST_CASE("Merge reads by batch", "[merge]") {
+    auto s = merge_sorted(make_range(0, 1000, 3), make_range(1, 1000, 3), make_range(2, 1000, 3));
+
+    vector<int> v(1000);
+    size_t n = 0;
+    while(size_t const k = s.next_batch(v.data() + n, min<size_t>(7, v.size() - n)))
+        n += k;
+    REQUIRE(n == 1000);
+    for(int i = 0; i < 1000; ++i)
+        REQUIRE(v[i] == i);
+}
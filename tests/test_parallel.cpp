@@ -0,0 +1,116 @@
+#include <plusar/parallel.hpp>
+#include "catch.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace plusar;
+using namespace std;
+
+TEST_CASE("Thread pool", "[parallel]") {
+    thread_pool pool(4);
+    REQUIRE(pool.size() == 4);
+
+    vector<future<int>> results;
+    for(int i = 0; i < 100; ++i)
+        results.push_back(pool.submit([i]() { return i * i; }));
+
+    for(int i = 0; i < 100; ++i)
+        REQUIRE(results[i].get() == i * i);
+}
+
+TEST_CASE("Parallel reduce over split stream", "[parallel]") {
+    thread_pool pool(4);
+
+    auto s = make_range(int64_t{ 0 }, int64_t{ 1000000 })
+                .map([](int64_t t) { return t * 3; })
+                .filter([](int64_t t) { return t % 2 == 0; });
+
+    REQUIRE(parallel_reduce(s, int64_t{ 0 }, std::plus<>(), std::plus<>(), pool) == s.sum());
+}
+
+TEST_CASE("Parallel reduce keeps order", "[parallel]") {
+    thread_pool pool(3);
+
+    vector<string> v;
+    for(int i = 0; i < 5000; ++i)
+        v.push_back(to_string(i % 10));
+
+    auto concat = [](string a, string const &b) { return a + b; };
+    auto const expected = make_stream(v).reduce(string(), concat).collect();
+    REQUIRE(parallel_reduce(make_stream(v), string(), concat, concat, pool, 16) == expected);
+}
+
+TEST_CASE("Parallel for each", "[parallel]") {
+    thread_pool pool(2);
+    atomic<int64_t> sum{ 0 };
+    parallel_for_each(make_range(0, 10000), [&sum](int t) { sum += t; }, pool);
+    REQUIRE(sum == 49995000);
+
+    atomic<int> n{ 0 };
+    parallel_for_each(make_stream([]() { return make_optional(1); }).take(100), [&n](int) { ++n; }, pool);
+    REQUIRE(n == 100);
+}
+
+TEST_CASE("Parallel map keeps order", "[parallel]") {
+    vector<int> v;
+    make_range(0, 1000)
+        .parallel_map([](int t)
+        {
+            if (t % 7 == 0)
+                this_thread::sleep_for(chrono::microseconds(50));
+            return t * 2;
+        }, 4, 16)
+        .collect(back_inserter(v));
+
+    REQUIRE(v.size() == 1000);
+    for(int i = 0; i < 1000; ++i)
+        REQUIRE(v[i] == i * 2);
+}
+
+TEST_CASE("Unordered parallel map", "[parallel]") {
+    vector<int> v;
+    make_range(0, 1000)
+        .parallel_map_unordered([](int t) { return t * 2; }, 4, 16)
+        .collect(back_inserter(v));
+
+    sort(v.begin(), v.end());
+    REQUIRE(v.size() == 1000);
+    for(int i = 0; i < 1000; ++i)
+        REQUIRE(v[i] == i * 2);
+}
+
+TEST_CASE("Parallel map window bounds elements in flight", "[parallel]") {
+    atomic<int> pulled{ 0 };
+    atomic<int> consumed{ 0 };
+    bool bounded = true;
+
+    auto s = make_stream([&pulled]() { return make_optional(pulled++); })
+                .take(200)
+                .parallel_map([](int t) { return t; }, 3, 8);
+
+    for(auto v = s.next(); v; v = s.next())
+    {
+        ++consumed;
+        bounded = bounded && pulled - consumed < 8;
+    }
+
+    REQUIRE(consumed == 200);
+    REQUIRE(bounded);
+}
+
+TEST_CASE("Parallel map rethrows exceptions", "[parallel]") {
+    auto fn = [](int t) { if (t == 3) throw runtime_error("bad element"); return t; };
+
+    auto ordered = make_range(0, 10).parallel_map(fn, 2, 4);
+    REQUIRE(ordered.next() == 0);
+    REQUIRE(ordered.next() == 1);
+    REQUIRE(ordered.next() == 2);
+    REQUIRE_THROWS_AS(ordered.next(), runtime_error);
+
+    REQUIRE_THROWS_AS(make_range(0, 10).parallel_map_unordered(fn, 2, 4).count(), runtime_error);
+}
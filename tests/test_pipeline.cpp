@@ -0,0 +1,114 @@
+#include <plusar/pipeline.hpp>
+#include "catch.hpp"
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace plusar;
+using namespace std;
+
+namespace
+{
+    template<typename T>
+    vector<T> drain(any_stream<T> const &s)
+    {
+        vector<T> v;
+        s.collect(back_inserter(v));
+        return v;
+    }
+}
+
+TEST_CASE("Pipeline from JSON", "[pipeline]") {
+    auto p = make_pipeline<int64_t>(make_range<int64_t>(0, 20), R"({
+        "name": "example",
+        "stages": [
+            { "op": "filter", "cmp": "ge", "value": 10 },
+            { "op": "map", "fn": "mul", "value": 2 },
+            { "op": "take", "n": 3 }
+        ]
+    })");
+
+    REQUIRE(drain(p) == vector<int64_t>{ 20, 22, 24 });
+}
+
+TEST_CASE("Pipeline from INI", "[pipeline]") {
+    auto p = make_pipeline<double>(make_range<int64_t>(1, 11), R"(
+        # averages of windows of four elements
+        [cast]
+        to = double
+
+        [aggregate]
+        fn = mean
+        window = 4
+    )");
+
+    REQUIRE(drain(p) == vector<double>{ 2.5, 6.5, 9.5 });
+}
+
+TEST_CASE("Pipeline aggregates", "[pipeline]") {
+    auto const source = make_stream(vector<int64_t>{ 5, 3, 8, 1, 9 });
+
+    REQUIRE(drain(make_pipeline<int64_t>(source, "[aggregate]\nfn = sum")) == vector<int64_t>{ 26 });
+    REQUIRE(drain(make_pipeline<int64_t>(source, "[aggregate]\nfn = min\nwindow = 2")) == vector<int64_t>{ 3, 1, 9 });
+    REQUIRE(drain(make_pipeline<int64_t>(source, "[aggregate]\nfn = max\nwindow = 3")) == vector<int64_t>{ 8, 9 });
+    REQUIRE(drain(make_pipeline<int64_t>(source, R"([{ "op": "aggregate", "fn": "count", "window": 2 }])")) == vector<int64_t>{ 2, 2, 1 });
+}
+
+TEST_CASE("Pipeline of strings", "[pipeline]") {
+    auto p = make_pipeline<int64_t>(make_stream(vector<string>{ "apple", "banana", "avocado", "cherry" }), R"([
+        { "op": "filter", "cmp": "prefix", "value": "a" },
+        { "op": "map", "fn": "upper" },
+        { "op": "filter", "cmp": "contains", "value": "OCA" },
+        { "op": "map", "fn": "length" }
+    ])");
+
+    REQUIRE(drain(p) == vector<int64_t>{ 7 });
+}
+
+TEST_CASE("Pipeline errors are reported at load time", "[pipeline]") {
+    auto const source = make_range<int64_t>(0, 10);
+
+    REQUIRE_THROWS_WITH(make_pipeline<int64_t>(source, "[sort]"), "stage 1 'sort': unknown operator");
+    REQUIRE_THROWS_WITH(make_pipeline<int64_t>(source, "[cast]\nto = string\n[aggregate]\nfn = sum"),
+                        Catch::StartsWith("stage 2 'aggregate': doesn't accept string elements"));
+    REQUIRE_THROWS_WITH(make_pipeline<int64_t>(source, "[cast]\nto = double"), "pipeline produces double elements, int64 expected");
+    REQUIRE_THROWS_WITH(make_pipeline<int64_t>(source, "[filter]\ncmp = gt"), "stage 'filter': missing parameter 'value'");
+    REQUIRE_THROWS_WITH(make_pipeline<int64_t>(source, "[take]\nn = many"), "stage 'take': invalid value of 'n'");
+    REQUIRE_THROWS_AS(make_pipeline<int64_t>(source, R"([{ "op": "take", "n": [1] }])"), pipeline_error);
+    REQUIRE_THROWS_AS(make_pipeline<int64_t>(source, "n = 1"), pipeline_error);
+}
+
+TEST_CASE("Pipeline JSON must be a single document", "[pipeline]") {
+    auto const source = make_range<int64_t>(0, 10);
+
+    REQUIRE(drain(make_pipeline<int64_t>(source, "{ \"stages\": [ { \"op\": \"take\", \"n\": 2 } ] }\n")) == vector<int64_t>{ 0, 1 });
+    REQUIRE_THROWS_WITH(make_pipeline<int64_t>(source, R"([{ "op": "take", "n": 2 }] [)"),
+                        "JSON offset 27: unexpected text after the pipeline description");
+    REQUIRE_THROWS_AS(make_pipeline<int64_t>(source, R"({ "stages": [] } x)"), pipeline_error);
+    REQUIRE_THROWS_AS(make_pipeline<int64_t>(source, string(R"([{ "op": "take", "n": )") + '\0'), pipeline_error);
+}
+
+TEST_CASE("Pipeline integer parameters span the int64 range", "[pipeline]") {
+    auto const source = make_stream(vector<int64_t>{ INT64_MIN, -1, INT64_MAX });
+
+    REQUIRE(drain(make_pipeline<int64_t>(source, R"([{ "op": "filter", "cmp": "gt", "value": -9223372036854775808 }])"))
+            == vector<int64_t>{ -1, INT64_MAX });
+    REQUIRE(drain(make_pipeline<int64_t>(source, R"([{ "op": "filter", "cmp": "lt", "value": 9223372036854775807 }])"))
+            == vector<int64_t>{ INT64_MIN, -1 });
+    REQUIRE_THROWS_WITH(make_pipeline<int64_t>(source, R"([{ "op": "filter", "cmp": "gt", "value": -9223372036854775809 }])"),
+                        "stage 'filter': invalid value of 'value'");
+}
+
+TEST_CASE("Custom operators", "[pipeline]") {
+    struct point
+    {
+        int64_t x = 0, y = 0;
+    };
+
+    operator_registry registry = operator_registry::standard();
+    registry.add_type<point>("point")
+            .add<point>("x", [](any_stream<point> const &src, stage_config const &) { return src.map([](point p) { return p.x; }); });
+
+    auto p = make_pipeline<int64_t>(make_stream(vector<point>{ { 1, 2 }, { 3, 4 } }), "[x]\n[aggregate]\nfn = sum", registry);
+    REQUIRE(drain(p) == vector<int64_t>{ 4 });
+}
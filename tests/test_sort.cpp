@@ -0,0 +1,178 @@
+#include <plusar/sort.hpp>
+#include <plusar/generate.hpp>
+#include <plusar/parallel.hpp>
+#include "catch.hpp"
+#include <functional>
+#include <algorithm>
+#include <iterator>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace plusar;
+using namespace std;
+
+namespace
+{
+    struct record
+    {
+        uint32_t key;
+        uint32_t seq;
+    };
+
+    template<typename S>
+    auto to_vector(S const &s)
+    {
+        vector<typename S::type> v;
+        s.collect(back_inserter(v));
+        return v;
+    }
+}
+
+TEST_CASE("Sort in memory", "[sort]") {
+    vector<int> input{ 5, -3, 9, 0, -3, 12, 7 };
+    vector<int> expected = input;
+    std::sort(expected.begin(), expected.end());
+
+    REQUIRE(to_vector(make_stream(input).sort()) == expected);
+    REQUIRE(to_vector(make_stream(input).sort(std::greater<>())) == vector<int>(expected.rbegin(), expected.rend()));
+    REQUIRE(make_range(0, 0).sort().count() == 0);
+}
+
+TEST_CASE("Sort integers and floats by radix", "[sort]") {
+    auto keys = gen::uniform(1 << 20, 100000, 42).map([](uint64_t k) { return static_cast<int64_t>(k) - (1 << 19); });
+    auto v = to_vector(keys.sort());
+    REQUIRE(v.size() == 100000);
+    REQUIRE(is_sorted(v.begin(), v.end()));
+
+    auto d = to_vector(keys.map([](int64_t k) { return static_cast<double>(k) / 3; }).sort());
+    REQUIRE(is_sorted(d.begin(), d.end()));
+    REQUIRE(d.front() < 0);
+}
+
+TEST_CASE("Sort spills runs beyond the memory budget", "[sort]") {
+    auto keys = gen::uniform(1000000, 200000, 7);
+    auto sorted = keys.sort(std::less<>(), 64 * 1024);
+
+    auto expected = to_vector(keys);
+    std::sort(expected.begin(), expected.end());
+
+    REQUIRE(sorted.size_hint() == 200000u);
+    REQUIRE(sorted.next() == expected[0]);
+    REQUIRE(sorted.size_hint() == 199999u);
+
+    vector<uint64_t> v{ expected[0] };
+    sorted.collect(back_inserter(v));
+    REQUIRE(v == expected);
+}
+
+TEST_CASE("Sort records with a comparator beyond the memory budget", "[sort]") {
+    auto by_key = [](record const &a, record const &b) { return a.key < b.key; };
+    auto records = gen::uniform(1000, 50000, 3).map([n = make_shared<uint32_t>(0)](uint64_t k) { return record{ static_cast<uint32_t>(k), (*n)++ }; });
+
+    auto v = to_vector(records.sort(by_key, 16 * 1024));
+    REQUIRE(v.size() == 50000);
+    REQUIRE(is_sorted(v.begin(), v.end(), by_key));
+}
+
+TEST_CASE("Sort spills encoded strings beyond the memory budget", "[sort]") {
+    auto words = make_stream(vector<string>{ "pear", "apple", "", "fig", "banana" });
+    REQUIRE(to_vector(words.sort(std::less<>(), 16)) == vector<string>{ "", "apple", "banana", "fig", "pear" });
+
+    auto lines = gen::payload(0, 300, 20000, 5);
+    auto sorted = lines.sort(std::less<>(), 256 * 1024);
+    auto expected = to_vector(lines);
+    std::sort(expected.begin(), expected.end());
+    REQUIRE(to_vector(sorted) == expected);
+
+    // Elements longer than a block of a spilled run
+    auto pages = gen::payload(5000, 9000, 50, 3);
+    auto sorted_pages = pages.sort(std::less<>(), 4096);
+    auto expected_pages = to_vector(pages);
+    std::sort(expected_pages.begin(), expected_pages.end());
+    REQUIRE(to_vector(sorted_pages) == expected_pages);
+
+    auto blobs = gen::uniform(1000, 3000, 8).map([](uint64_t k) { return vector<uint16_t>(k % 7, static_cast<uint16_t>(k)); });
+    auto v = to_vector(blobs.sort(std::less<>(), 8 * 1024));
+    REQUIRE(v.size() == 3000);
+    REQUIRE(is_sorted(v.begin(), v.end()));
+}
+
+TEST_CASE("Sort without a budget keeps any element in memory", "[sort]") {
+    struct named
+    {
+        string name;
+        bool operator < (named const &other) const { return name < other.name; }
+    };
+
+    auto v = to_vector(make_stream(vector<named>{ { "b" }, { "a" } }).sort());
+    REQUIRE(v.size() == 2);
+    REQUIRE(v[0].name == "a");
+    STATIC_REQUIRE(!internal::sort_fn<decltype(make_stream(vector<named>{})), std::less<>>::spillable);
+}
+
+TEST_CASE("Sort rethrows a failure of its source", "[sort]") {
+    auto s = make_range(0, 100).map([](int v) { if (v == 50) throw runtime_error("decode failed"); return v; }).sort();
+    REQUIRE_THROWS_AS(s.next(), runtime_error);
+    REQUIRE_THROWS_AS(s.next(), runtime_error);
+    REQUIRE(s.size_hint() == nullopt);
+}
+
+TEST_CASE("Sorted collects elements by radix key", "[sort]") {
+    thread_pool pool(4);
+    auto keys = gen::uniform(1 << 20, 200000, 11).map([](uint64_t k) { return static_cast<int32_t>(k) - (1 << 19); });
+
+    auto v = keys.sorted([](int32_t k) { return k; }, false, &pool);
+    REQUIRE(v.size() == 200000);
+    REQUIRE(is_sorted(v.begin(), v.end()));
+    REQUIRE(make_stream(vector<double>{ 2.5, -1, 0, -7.25 }).sorted() == vector<double>{ -7.25, -1, 0, 2.5 });
+
+    // Equal keys keep their order
+    auto records = gen::uniform(100, 100000, 5).map([n = make_shared<uint32_t>(0)](uint64_t k) { return record{ static_cast<uint32_t>(k), (*n)++ }; });
+    auto r = records.sorted([](record const &x) { return x.key; }, false, &pool);
+    REQUIRE(r.size() == 100000);
+    REQUIRE(is_sorted(r.begin(), r.end(), [](record const &a, record const &b) { return a.key < b.key || (a.key == b.key && a.seq < b.seq); }));
+}
+
+TEST_CASE("Sorted keeps the order of signed zeros and NaN keys", "[sort]") {
+    struct sample
+    {
+        double   value;
+        uint32_t seq;
+    };
+
+    double const nan = numeric_limits<double>::quiet_NaN();
+    vector<sample> samples;
+    for(uint32_t i = 0; i < 1000; ++i)
+    {
+        double const values[] = { 0.0, -0.0, 1.5, -1.5, nan, -nan };
+        samples.push_back(sample{ values[i % 6], i });
+    }
+
+    thread_pool pool(2);
+    auto v = make_stream(samples).sorted([](sample const &x) { return x.value; }, false, &pool);
+    REQUIRE(v.size() == samples.size());
+
+    auto const rank = [](double x) { return x != x ? 3 : x < 0 ? 0 : x == 0 ? 1 : 2; };
+    REQUIRE(is_sorted(v.begin(), v.end(), [&](sample const &a, sample const &b)
+    {
+        return rank(a.value) < rank(b.value) || (rank(a.value) == rank(b.value) && a.seq < b.seq);
+    }));
+}
+
+TEST_CASE("Sorted merges parts sorted by the workers", "[sort]") {
+    thread_pool pool(3);
+    auto by_name = [](record const &x) { return to_string(x.key); };
+    auto records = to_vector(gen::uniform(1000, 100001, 9).map([n = make_shared<uint32_t>(0)](uint64_t k) { return record{ static_cast<uint32_t>(k), (*n)++ }; }));
+
+    auto expected = records;
+    stable_sort(expected.begin(), expected.end(), [&](record const &a, record const &b) { return by_name(a) < by_name(b); });
+
+    auto v = make_stream(records).sorted(by_name, true, &pool);
+    REQUIRE(equal(v.begin(), v.end(), expected.begin(), expected.end(), [](record const &a, record const &b) { return a.seq == b.seq; }));
+
+    auto unstable = make_stream(records).sorted(by_name, false, &pool);
+    REQUIRE(equal(unstable.begin(), unstable.end(), expected.begin(), expected.end(), [](record const &a, record const &b) { return a.key == b.key; }));
+}
@@ -1,8 +1,11 @@
 #include <plusar/stream.hpp>
+#include <plusar/aggregate.hpp>
 #include "catch.hpp"
 #include <functional>
 #include <vector>
 #include <iterator>
+#include <string>
+#include <cmath>
 
 using namespace plusar;
 using namespace std;
@@ -69,6 +72,65 @@ TEST_CASE("Flatten stream 2", "[stream]") {
     REQUIRE_THROWS(ss.collect());
 }
 
+namespace
+{
+    // Counts copies of the inner streams capturing it
+    struct copy_counter
+    {
+        static inline int copies = 0;
+
+        copy_counter() = default;
+        copy_counter(copy_counter const &) { ++copies; }
+        copy_counter(copy_counter &&) = default;
+    };
+}
+
+TEST_CASE("Flatten moves inner streams", "[stream]") {
+    copy_counter::copies = 0;
+
+    auto ss = make_range(0, 4)
+                .map([](int i) { return make_range(i * 3, i * 3 + 3).map([c = copy_counter{}](int v) { return v; }); })
+                .flatten();
+
+    REQUIRE(ss.reduce(0, std::plus<>()).collect() == 66);
+    REQUIRE(copy_counter::copies == 0);
+}
+
+TEST_CASE("Flatten skips empty inner streams", "[stream]") {
+    auto ss = make_range(0, 6)
+                .map([](int i) { return make_range(0, i % 3); })
+                .flatten();
+
+    vector<int> v;
+    ss.collect(std::back_inserter(v));
+    REQUIRE(v == vector<int>{ 0, 0, 1, 0, 0, 1 });
+}
+
+TEST_CASE("Flat map into inner streams", "[stream]") {
+    copy_counter::copies = 0;
+
+    auto ss = make_range(1, 4)
+                .flat_map([c = copy_counter{}](int i) { return make_range(0, i).map([c = copy_counter{}](int v) { return v; }); });
+
+    vector<int> v;
+    ss.collect(std::back_inserter(v));
+    REQUIRE(v == vector<int>{ 0, 0, 1, 0, 1, 2 });
+    REQUIRE(copy_counter::copies == 0);
+}
+
+TEST_CASE("Flat map into a reused buffer", "[stream]") {
+    auto ss = make_range(0, 5)
+                .flat_map<string>([](int i, vector<string> &out)
+                {
+                    for(int j = 0; j < i % 3; ++j)
+                        out.push_back(to_string(i) + ":" + to_string(j));
+                });
+
+    vector<string> v;
+    ss.collect(std::back_inserter(v));
+    REQUIRE(v == vector<string>{ "1:0", "2:0", "2:1", "4:0" });
+}
+
 TEST_CASE("Take N elements", "[stream]") {
     REQUIRE(make_stream([]() { return make_optional(5); })
                 .take(3)
@@ -92,6 +154,41 @@ TEST_CASE("Skip N elements", "[stream]") {
                 .collect() == 12);
 }
 
+TEST_CASE("Chunk views of a reused buffer", "[stream][chunk]") {
+    auto chunks = make_range(0, 10).chunk(4);
+    REQUIRE(chunks.size_hint() == 3u);
+
+    vector<vector<int>> v;
+    int const *buffer = nullptr;
+    for(auto c = chunks.next(); c; c = chunks.next())
+    {
+        if (buffer)
+            REQUIRE(c->data() == buffer);
+        buffer = c->data();
+        v.emplace_back(c->begin(), c->end());
+    }
+    REQUIRE(v == vector<vector<int>>{ { 0, 1, 2, 3 }, { 4, 5, 6, 7 }, { 8, 9 } });
+
+    REQUIRE(make_range(0, 8).chunk(4).count() == 2);
+    REQUIRE(make_range(0, 0).chunk(4).count() == 0);
+    REQUIRE(make_range(0, 10).chunk(3).skip(2).next()->size() == 3);
+    REQUIRE(make_range(0, 10).chunk(3).skip(3).next()->size() == 1);
+}
+
+TEST_CASE("Chunk vectors own their elements", "[stream][chunk]") {
+    auto chunks = make_stream(vector<string>{ "a", "b", "c", "d", "e" })
+                    .filter([](string const &s) { return s != "c"; })
+                    .chunk_vector(3);
+
+    vector<vector<string>> v;
+    chunks.collect(std::back_inserter(v));
+    REQUIRE(v == vector<vector<string>>{ { "a", "b", "d" }, { "e" } });
+
+    auto endless = iota(0).chunk_vector(2);
+    REQUIRE(endless.size_hint() == SIZE_MAX);
+    REQUIRE(endless.take(3).map([](vector<int> const &c) { return c[0] + c[1]; }).sum() == 15);
+}
+
 TEST_CASE("Zip streams", "[stream]") {
     auto s1 = make_stream({ 1, 2, 3 });
     auto s2 = make_stream({ -1, -2, -3, -4 });
@@ -153,3 +250,300 @@ TEST_CASE("Read next item from stream", "[stream]") {
     REQUIRE(s.next() == 1);
     REQUIRE(s.next() == 2);
 }
+
+TEST_CASE("Fuse adjacent maps", "[stream][fusion]") {
+    auto s = make_stream({ 1, 2, 3 })
+                .map([](int t) { return t + 1; })
+                .map([](int t) { return t * 10; })
+                .map([](int t) { return std::to_string(t); });
+
+    REQUIRE(s.next() == "20");
+    REQUIRE(s.next() == "30");
+    REQUIRE(s.next() == "40");
+    REQUIRE_THROWS(s.collect());
+}
+
+TEST_CASE("Fuse adjacent filters", "[stream][fusion]") {
+    int calls = 0;
+    auto s = make_stream({ 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 })
+                .filter([&calls](int t) { ++calls; return t % 2 == 0; })
+                .filter([](int t) { return t % 3 == 0; });
+
+    REQUIRE(s.next() == 6);
+    REQUIRE(s.next() == 12);
+    REQUIRE_THROWS(s.collect());
+    REQUIRE(calls == 12);
+}
+
+TEST_CASE("Fuse adjacent take and skip", "[stream][fusion]") {
+    int n = 0;
+    REQUIRE(make_stream([&n]() { return make_optional(n++); })
+                .take(10)
+                .take(3)
+                .reduce(0, std::plus<>())
+                .collect() == 3);
+
+    int m = 0;
+    REQUIRE(make_stream([&m]() { return make_optional(m++); })
+                .skip(2)
+                .skip(3)
+                .take(2)
+                .reduce(0, std::plus<>())
+                .collect() == 11);
+
+    int k = 0;
+    auto partial = make_stream([&k]() { return make_optional(k++); })
+                    .take(5);
+    REQUIRE(partial.next() == 0);
+    REQUIRE(partial.next() == 1);
+    auto rest = partial.take(10);
+    REQUIRE(rest.next() == 2);
+    REQUIRE(rest.next() == 3);
+    REQUIRE(rest.next() == 4);
+    REQUIRE_THROWS(rest.collect());
+}
+
+TEST_CASE("Pure map isn't evaluated for skipped elements", "[stream][lazy]") {
+    int n = 0;
+    int calls = 0;
+    auto s = make_stream([&n]() { return make_optional(n++); })
+                .map(pure([&calls](int t) { ++calls; return t * 2; }))
+                .skip(1000);
+
+    REQUIRE(s.next() == 2000);
+    REQUIRE(calls == 1);
+
+    int m = 0;
+    int sliced_calls = 0;
+    auto sliced = make_stream([&m]() { return make_optional(m++); })
+                    .map(pure([&sliced_calls](int t) { ++sliced_calls; return t; }))
+                    .slice(0, 100, 10);
+
+    for(int i = 0; i < 100; i += 10)
+        REQUIRE(sliced.next() == i);
+    REQUIRE_THROWS(sliced.collect());
+    REQUIRE(sliced_calls == 10);
+}
+
+TEST_CASE("Impure map is evaluated for skipped elements", "[stream][lazy]") {
+    int calls = 0;
+    auto s = make_stream({ 1, 2, 3, 4 })
+                .map([&calls](int t) { ++calls; return t; })
+                .skip(2);
+
+    REQUIRE(s.next() == 3);
+    REQUIRE(calls == 3);
+}
+
+TEST_CASE("Advance stream", "[stream][lazy]") {
+    auto s = make_stream({ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 })
+                .map(pure([](int t) { return t; }))
+                .map(pure([](int t) { return t + 1; }))
+                .skip(1)
+                .take(6);
+
+    REQUIRE(s.advance(2) == 2);
+    REQUIRE(s.next() == 4);
+    REQUIRE(s.advance(10) == 3);
+    REQUIRE_THROWS(s.collect());
+}
+
+TEST_CASE("Range stream", "[stream][range]") {
+    std::vector<int> v;
+    make_range(0, 10, 3).collect(std::back_inserter(v));
+    REQUIRE(v == std::vector<int>{ 0, 3, 6, 9 });
+
+    v.clear();
+    make_range(10, 0, -4).collect(std::back_inserter(v));
+    REQUIRE(v == std::vector<int>{ 10, 6, 2 });
+
+    REQUIRE(make_range(5, 5).size_hint() == 0u);
+    REQUIRE(make_range(0.0, 1.0, 0.25).size_hint() == 4u);
+    REQUIRE(make_range(0, 100).skip(10).take(20).size_hint() == 20u);
+    REQUIRE(make_range(0, 100).slice(10, 50, 7).size_hint() == 6u);
+    REQUIRE(make_range(0, 100).filter([](int) { return true; }).size_hint() == std::nullopt);
+}
+
+TEST_CASE("Iota stream", "[stream][range]") {
+    auto s = iota(uint64_t{ 5 }, uint64_t{ 5 });
+    REQUIRE(s.size_hint() == SIZE_MAX);
+    REQUIRE(s.next() == 5u);
+    REQUIRE(s.advance(1000000000) == 1000000000u);
+    REQUIRE(s.next() == 5000000010u);
+    REQUIRE(s.take(3).size_hint() == 3u);
+}
+
+TEST_CASE("Random access stream", "[stream][range]") {
+    auto s = make_range(0, 100)
+                .map([](int t) { return t * 2; })
+                .skip(10)
+                .slice_to_end(0, 5)
+                .take(4);
+
+    REQUIRE(s.at(0) == 20);
+    REQUIRE(s.at(3) == 50);
+    REQUIRE(s.at(4) == std::nullopt);
+    REQUIRE(s.next() == 20);
+    REQUIRE(s.at(0) == 30);
+    REQUIRE(make_stream({ 1, 2, 3 }).at(2) == 3);
+}
+
+TEST_CASE("Read elements by batch", "[stream][range]") {
+    int out[8] = {};
+    auto s = make_range(0, 10).skip(1);
+    REQUIRE(s.next_batch(out, 8) == 8);
+    REQUIRE(out[0] == 1);
+    REQUIRE(out[7] == 8);
+    REQUIRE(s.next_batch(out, 8) == 1);
+    REQUIRE(out[0] == 9);
+
+    int n = 0;
+    auto f = make_stream([&n]() { return n < 3 ? make_optional(n++) : nullopt; });
+    REQUIRE(f.next_batch(out, 8) == 3);
+    REQUIRE(out[2] == 2);
+}
+
+TEST_CASE("Reduce range in closed form", "[stream][range]") {
+    REQUIRE(make_range(1, 101)
+                .reduce(0, std::plus<>())
+                .collect() == 5050);
+    REQUIRE(make_range(int64_t{ 0 }, int64_t{ 3000000000 }, int64_t{ 3 })
+                .reduce(int64_t{ 0 }, std::plus<>())
+                .collect() == 1499999998500000000);
+    REQUIRE(make_range(10, -10, -3)
+                .reduce(0, std::plus<>())
+                .collect() == 10 + 7 + 4 + 1 - 2 - 5 - 8);
+}
+
+TEST_CASE("Find element", "[stream][terminal]") {
+    int pulled = 0;
+    auto s = make_stream([&pulled]() { return make_optional(pulled++); });
+
+    REQUIRE(s.find([](int t) { return t > 4; }) == 5);
+    REQUIRE(pulled == 6);
+    REQUIRE(make_stream({ 1, 2, 3 }).find([](int t) { return t > 4; }) == std::nullopt);
+}
+
+TEST_CASE("Match predicates", "[stream][terminal]") {
+    int pulled = 0;
+    auto s = make_stream([&pulled]() { return make_optional(pulled++); });
+
+    REQUIRE(s.any_of([](int t) { return t == 3; }));
+    REQUIRE(pulled == 4);
+    REQUIRE_FALSE(s.all_of([](int t) { return t < 10; }));
+    REQUIRE(pulled == 11);
+    REQUIRE(make_range(0, 10).all_of([](int t) { return t < 10; }));
+    REQUIRE(make_range(0, 10).none_of([](int t) { return t > 10; }));
+    REQUIRE_FALSE(make_range(0, 10).none_of([](int t) { return t == 5; }));
+}
+
+TEST_CASE("First and nth elements", "[stream][terminal]") {
+    REQUIRE(make_stream({ 7, 8, 9 }).first() == 7);
+    REQUIRE(make_stream({ 7, 8, 9 }).nth(2) == 9);
+    REQUIRE(make_stream({ 7, 8, 9 }).nth(3) == std::nullopt);
+
+    int calls = 0;
+    REQUIRE(iota(0)
+                .map(pure([&calls](int t) { ++calls; return t * 2; }))
+                .nth(1000000) == 2000000);
+    REQUIRE(calls == 1);
+}
+
+TEST_CASE("Count elements", "[stream][terminal]") {
+    REQUIRE(make_range(0, 1000000000).map(pure([](int t) { return t * 2; })).count() == 1000000000u);
+
+    int calls = 0;
+    REQUIRE(make_range(0, 1000).map([&calls](int t) { ++calls; return t * 2; }).count() == 1000u);
+    REQUIRE(calls == 1000);
+    REQUIRE(make_range(0, 10).filter([](int t) { return t % 2; }).count() == 5u);
+
+    int n = 0;
+    REQUIRE(make_stream([&n]() { return make_optional(n++); }).take(7).count() == 7u);
+}
+
+TEST_CASE("Min, max and sum of elements", "[stream][terminal]") {
+    REQUIRE(make_stream({ 3, 1, 4, 1, 5 }).min() == 1);
+    REQUIRE(make_stream({ 3, 1, 4, 1, 5 }).max() == 5);
+    REQUIRE(make_stream({ 3, 1, 4, 1, 5 }).max(std::greater<>()) == 1);
+    REQUIRE(make_range(0, 0).min() == std::nullopt);
+    REQUIRE(make_stream({ 3, 1, 4, 1, 5 }).sum() == 14);
+    REQUIRE(make_range(int64_t{ 0 }, int64_t{ 100001 }).sum() == 5000050000);
+}
+
+TEST_CASE("Aggregate in a single pass", "[stream][aggregate]") {
+    int pulled = 0;
+    auto [count, sum, min, max, mean, variance, stddev, product] =
+        make_stream([&pulled]() { return make_optional(pulled++); })
+            .take(5)
+            .map([](int t) { return t * 2 + 2; })
+            .aggregate(agg::count(),
+                       agg::sum(),
+                       agg::min(),
+                       agg::max(),
+                       agg::mean(),
+                       agg::variance(),
+                       agg::stddev(0),
+                       agg::fold(1, std::multiplies<>()));
+
+    REQUIRE(pulled == 5);
+    REQUIRE(count == 5u);
+    REQUIRE(sum == 30);
+    REQUIRE(min == 2);
+    REQUIRE(max == 10);
+    REQUIRE(mean == Approx(6.0));
+    REQUIRE(variance == Approx(10.0));
+    REQUIRE(stddev == Approx(std::sqrt(8.0)));
+    REQUIRE(product == 3840);
+}
+
+TEST_CASE("Aggregate empty stream", "[stream][aggregate]") {
+    auto [count, min, variance] = make_range(0, 0).aggregate(agg::count(), agg::min(), agg::variance());
+    REQUIRE(count == 0u);
+    REQUIRE(min == std::nullopt);
+    REQUIRE(variance == 0.0);
+}
+
+TEST_CASE("Split range stream", "[stream][split]") {
+    auto s = make_range(0, 10).map([](int t) { return t * 2; });
+    auto prefix = s.try_split();
+
+    REQUIRE(prefix);
+    REQUIRE(prefix->size_hint() == 5u);
+    REQUIRE(s.size_hint() == 5u);
+    REQUIRE(prefix->next() == 0);
+    REQUIRE(s.next() == 10);
+
+    REQUIRE_FALSE(iota(0).try_split());
+    REQUIRE_FALSE(make_range(0, 10).take(5).try_split());
+    REQUIRE_FALSE(make_range(0, 1).try_split());
+}
+
+TEST_CASE("Split array stream", "[stream][split]") {
+    auto s = make_stream({ 1, 2, 3, 4, 5 }).filter([](int t) { return t != 2; });
+    auto prefix = s.try_split();
+
+    REQUIRE(prefix);
+    std::vector<int> head, tail;
+    prefix->collect(std::back_inserter(head));
+    s.collect(std::back_inserter(tail));
+    REQUIRE(head == std::vector<int>{ 1 });
+    REQUIRE(tail == std::vector<int>{ 3, 4, 5 });
+}
+
+TEST_CASE("Container stream", "[stream][split]") {
+    std::vector<int> v{ 1, 2, 3, 4, 5, 6 };
+    auto s = make_stream(v);
+
+    REQUIRE(s.size_hint() == 6u);
+    REQUIRE(s.at(5) == 6);
+
+    auto copy = s;
+    REQUIRE(copy.sum() == 21);
+
+    auto prefix = s.try_split();
+    REQUIRE(prefix);
+    REQUIRE(prefix->sum() == 6);
+    REQUIRE(s.sum() == 15);
+
+    REQUIRE(make_stream(std::string("abc")).count() == 3u);
+}
@@ -0,0 +1,88 @@
+#include <plusar/tee.hpp>
+#include "catch.hpp"
+#include <functional>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+using namespace plusar;
+using namespace std;
+
+namespace
+{
+    // Counts live instances to observe when chunks are released
+    struct tracked
+    {
+        static inline int live = 0;
+        int value = 0;
+
+        tracked() { ++live; }
+        explicit tracked(int v) : value(v) { ++live; }
+        tracked(tracked const &other) : value(other.value) { ++live; }
+        ~tracked() { --live; }
+        tracked & operator = (tracked const &) = default;
+    };
+}
+
+TEST_CASE("Tee evaluates the upstream once", "[tee]") {
+    int decoded = 0;
+    auto branches = make_range(0, 1000)
+                        .map([&decoded](int v) { ++decoded; return v * 2; })
+                        .tee(3, 16);
+
+    REQUIRE(branches.size() == 3);
+    REQUIRE(branches[0].take(10).sum() == 90);
+    REQUIRE(branches[1].reduce(0, std::plus<>()).collect() == 999000);
+    REQUIRE(branches[2].count() == 1000);
+    REQUIRE(branches[0].count() == 1000);        // take read from a copy of the branch
+    REQUIRE(decoded == 1000);
+}
+
+TEST_CASE("Tee branches interleave", "[tee]") {
+    int n = 0;
+    auto branches = make_stream([&n]() { return n < 100 ? make_optional(n++) : nullopt; }).tee(2, 7);
+
+    vector<int> a, b;
+    for(int i = 0; i < 40; ++i)
+        a.push_back(*branches[0].next());
+    for(auto v = branches[1].next(); v; v = branches[1].next())
+        b.push_back(*v);
+    for(auto v = branches[0].next(); v; v = branches[0].next())
+        a.push_back(*v);
+
+    REQUIRE(a.size() == 100);
+    REQUIRE(a == b);
+    REQUIRE(!branches[0].next());
+}
+
+TEST_CASE("Tee releases chunks passed by every branch", "[tee]") {
+    tracked::live = 0;
+    {
+        auto branches = make_range(0, 10000).map([](int v) { return tracked(v); }).tee(2, 100);
+
+        branches[0].advance(5000);
+        int const ahead = tracked::live;
+        REQUIRE(ahead >= 5000);
+
+        branches[1].advance(5000);
+        REQUIRE(tracked::live <= 200);
+
+        REQUIRE(branches[0].next()->value == 5000);
+        REQUIRE(branches[1].next()->value == 5000);
+    }
+    REQUIRE(tracked::live == 0);
+}
+
+TEST_CASE("Tee branches on different threads", "[tee]") {
+    auto branches = make_range<int64_t>(0, 200000).tee(4, 64);
+
+    vector<int64_t> sums(branches.size());
+    vector<thread> threads;
+    for(size_t i = 0; i < branches.size(); ++i)
+        threads.emplace_back([&, i]() { sums[i] = branches[i].reduce(int64_t{ 0 }, std::plus<>()).collect(); });
+    for(auto &t : threads)
+        t.join();
+
+    for(auto s : sums)
+        REQUIRE(s == int64_t{ 199999 } * 200000 / 2);
+}
@@ -0,0 +1,83 @@
+#include <plusar/parallel.hpp>
+#include <plusar/trace.hpp>
+#include "catch.hpp"
+#include <sstream>
+#include <string>
+
+using namespace plusar;
+using namespace std;
+
+namespace
+{
+    size_t occurrences(string const &text, string const &what)
+    {
+        size_t n = 0;
+        for(auto pos = text.find(what); pos != string::npos; pos = text.find(what, pos + 1))
+            ++n;
+        return n;
+    }
+
+    string trace_json()
+    {
+        ostringstream os;
+        trace::write_json(os);
+        return os.str();
+    }
+}
+
+TEST_CASE("Trace stage spans", "[trace]") {
+    trace::start();
+    make_range(0, 10).map([](int t) { return t * 2; }).sum();
+    trace::stop();
+
+    auto const json = trace_json();
+    REQUIRE(json.find("\"traceEvents\"") != string::npos);
+    REQUIRE(json.find("\"thread_name\"") != string::npos);
+    REQUIRE(occurrences(json, "\"name\":\"map\"") == 11);
+    REQUIRE(occurrences(json, "\"name\":\"range\"") == 11);
+    REQUIRE(occurrences(json, "\"name\":\"reduce\"") == 1);
+}
+
+TEST_CASE("Trace isn't recorded when stopped", "[trace]") {
+    trace::start();
+    trace::stop();
+    make_range(0, 10).sum();
+
+    REQUIRE(occurrences(trace_json(), "\"ph\":\"X\"") == 0);
+}
+
+TEST_CASE("Trace sampling", "[trace]") {
+    trace::start(0.0);
+    make_range(0, 100).map([](int t) { return t; }).count();
+    trace::stop();
+    REQUIRE(occurrences(trace_json(), "\"ph\":\"X\"") == 0);
+
+    trace::start(0.5);
+    for(int i = 0; i < 1000; ++i)
+        trace::span span("outer", "test");
+    trace::stop();
+    auto const sampled = occurrences(trace_json(), "\"name\":\"outer\"");
+    REQUIRE(sampled > 350);
+    REQUIRE(sampled < 650);
+}
+
+TEST_CASE("Trace buffers are bounded", "[trace]") {
+    trace::start(1.0, 10);
+    for(int i = 0; i < 25; ++i)
+        trace::span span("event", "test");
+    trace::stop();
+
+    REQUIRE(occurrences(trace_json(), "\"name\":\"event\"") == 10);
+    REQUIRE(trace::dropped() == 15);
+}
+
+TEST_CASE("Trace queue waits of worker threads", "[trace]") {
+    trace::start();
+    make_range(0, 20).parallel_map([](int t) { return t; }, 2, 4).count();
+    trace::stop();
+
+    auto const json = trace_json();
+    REQUIRE(occurrences(json, "\"name\":\"queue wait\"") == 20);
+    REQUIRE(occurrences(json, "\"name\":\"parallel_map wait\"") == 21);
+    REQUIRE(occurrences(json, "\"name\":\"thread_name\"") >= 2);
+}